@@ -0,0 +1,166 @@
+#include "alloc_tracking.hpp"
+
+#ifdef ALLOC_TRACKING
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include <sys/resource.h>
+
+namespace{
+    struct AllocCounters{
+        std::atomic<unsigned long long> allocations{0};
+        std::atomic<unsigned long long> bytes{0};
+        std::atomic<long long> live{0};
+        std::atomic<long long> peak{0};
+    };
+
+    // Prefix of every tracked block, padded so the block keeps the default new alignment
+    struct AllocHeader{
+        size_t size;
+        unsigned char phase;
+        unsigned char structure;
+    };
+    const size_t headerSize = alignof(std::max_align_t);
+    static_assert(sizeof(AllocHeader) <= headerSize, "Allocation header does not fit its padding");
+
+    AllocCounters total;
+    AllocCounters phases[(size_t)AllocPhase::COUNT];
+    AllocCounters structures[(size_t)AllocStructure::COUNT];
+
+    std::atomic<unsigned char> currentPhase{(unsigned char)AllocPhase::STARTUP};
+    thread_local unsigned char currentStructure = (unsigned char)AllocStructure::OTHER;
+
+    const char* phaseNames[] = {"startup", "scan", "reconcile", "moves", "output"};
+    const char* structureNames[] = {"other", "file results", "scan index", "hash state", "sort", "patch", "patch text", "records"};
+
+    void charge(AllocCounters& counters, size_t size){
+        counters.allocations.fetch_add(1, std::memory_order_relaxed);
+        counters.bytes.fetch_add(size, std::memory_order_relaxed);
+
+        long long live = counters.live.fetch_add(size, std::memory_order_relaxed) + size;
+        long long peak = counters.peak.load(std::memory_order_relaxed);
+        while(live > peak && !counters.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)){}
+    }
+
+    void* allocate(size_t size){
+        void* block = std::malloc(size + headerSize);
+        if(!block){
+            return nullptr;
+        }
+
+        AllocHeader* header = static_cast<AllocHeader*>(block);
+        header->size = size;
+        header->phase = currentPhase.load(std::memory_order_relaxed);
+        header->structure = currentStructure;
+
+        charge(total, size);
+        charge(phases[header->phase], size);
+        charge(structures[header->structure], size);
+
+        return static_cast<char*>(block) + headerSize;
+    }
+
+    void release(void* pointer){
+        if(!pointer){
+            return;
+        }
+
+        // Live bytes go back to whatever the block was charged to when allocated
+        AllocHeader* header = reinterpret_cast<AllocHeader*>(static_cast<char*>(pointer) - headerSize);
+        total.live.fetch_sub(header->size, std::memory_order_relaxed);
+        phases[header->phase].live.fetch_sub(header->size, std::memory_order_relaxed);
+        structures[header->structure].live.fetch_sub(header->size, std::memory_order_relaxed);
+
+        std::free(header);
+    }
+
+    void printCounters(std::ostream& out, const char* name, const AllocCounters& counters){
+        if(counters.allocations > 0){
+            out << "  " << name << ": " << counters.allocations << " allocations, "
+                << counters.bytes << " bytes, " << counters.peak << " bytes peak live" << std::endl;
+        }
+    }
+}
+
+void* operator new(size_t size){
+    void* pointer = allocate(size);
+    if(!pointer){
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size){
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{
+    return allocate(size);
+}
+
+void operator delete(void* pointer) noexcept{
+    release(pointer);
+}
+
+void operator delete[](void* pointer) noexcept{
+    release(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept{
+    release(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept{
+    release(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept{
+    release(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept{
+    release(pointer);
+}
+
+AllocPhaseScope::AllocPhaseScope(AllocPhase phase)
+: previous((AllocPhase)currentPhase.exchange((unsigned char)phase)) {}
+
+AllocPhaseScope::~AllocPhaseScope(){
+    currentPhase = (unsigned char)this->previous;
+}
+
+AllocScope::AllocScope(AllocStructure structure)
+: previous((AllocStructure)currentStructure) {
+    currentStructure = (unsigned char)structure;
+}
+
+AllocScope::~AllocScope(){
+    currentStructure = (unsigned char)this->previous;
+}
+
+// Write the allocations, bytes and peak live bytes of every phase and structure, and the peak RSS
+void PrintAllocations(std::ostream& out){
+    out << "Allocations by phase:" << std::endl;
+    for(size_t phase = 0; phase < (size_t)AllocPhase::COUNT; phase++){
+        printCounters(out, phaseNames[phase], phases[phase]);
+    }
+
+    out << "Allocations by structure:" << std::endl;
+    for(size_t structure = 0; structure < (size_t)AllocStructure::COUNT; structure++){
+        printCounters(out, structureNames[structure], structures[structure]);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    out << "Heap: " << total.allocations << " allocations, " << total.peak << " bytes peak live, "
+        << "peak RSS " << usage.ru_maxrss * 1024LL << " bytes" << std::endl;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <ostream>
+
+// Pipeline phases heap allocations are charged to, one at a time for the whole process
+enum class AllocPhase : unsigned char{
+    STARTUP,
+    SCAN,
+    RECONCILE,
+    MOVES,
+    OUTPUT,
+    COUNT
+};
+
+// Data structures heap allocations are charged to, per thread
+enum class AllocStructure : unsigned char{
+    OTHER,
+    FILE_RESULTS,   // Scanned entries and their strings
+    SCAN_INDEX,     // Path to entry maps of the scans
+    HASH_STATE,     // Checksum instances, digests and read buffers
+    SORT,           // Path sort keys and permutations
+    PATCH,          // Reconcile result lists
+    PATCH_TEXT,     // Formatted patch sections
+    RECORDS,        // Scan records of runs and shards
+    COUNT
+};
+
+#ifdef ALLOC_TRACKING
+
+// Charges the allocations of the whole process to a phase until destroyed
+class AllocPhaseScope{
+private:
+    AllocPhase previous;
+
+public:
+    explicit AllocPhaseScope(AllocPhase phase);
+    ~AllocPhaseScope();
+
+    AllocPhaseScope(const AllocPhaseScope&) = delete;
+    AllocPhaseScope& operator=(const AllocPhaseScope&) = delete;
+};
+
+// Charges the allocations of the calling thread to a data structure until destroyed
+class AllocScope{
+private:
+    AllocStructure previous;
+
+public:
+    explicit AllocScope(AllocStructure structure);
+    ~AllocScope();
+
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+};
+
+// Write the allocations, bytes and peak live bytes of every phase and structure, and the peak RSS
+void PrintAllocations(std::ostream& out);
+
+#else
+
+// Tracking is compiled out (build with -DALLOC_TRACKING to enable it), scopes cost nothing
+class AllocPhaseScope{
+public:
+    explicit AllocPhaseScope(AllocPhase){}
+};
+
+class AllocScope{
+public:
+    explicit AllocScope(AllocStructure){}
+};
+
+inline void PrintAllocations(std::ostream&){}
+
+#endif
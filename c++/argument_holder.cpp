@@ -1,23 +1,20 @@
-#define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
-
 #include <iostream>
 #include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
 
-#include <cryptopp/cryptlib.h>
-#include <cryptopp/adler32.h>
-#include <cryptopp/crc.h>
-#include <cryptopp/md5.h>
-#include <cryptopp/sha.h>
-
 #include "argument_holder.hpp"
 
 ArgumentHolder::ArgumentHolder(){
     this->DirectoryA = "";
     this->DirectoryB = "";
-    this->Checksum = checksum_ptr(new CryptoPP::Weak::MD5());
+    this->Checksum = CreateChecksum("md5");
     this->ShouldIgnoreUnchanged = false;
+    this->CheckOnly = false;
+    this->ShouldDetectMoves = false;
+    this->ShardCount = 0;
+    this->IsShardWorker = false;
+    this->ShardIndex = 0;
 }
 
 bool ArgumentHolder::Parse(int argc, char** argv){
@@ -36,25 +33,251 @@ bool ArgumentHolder::Parse(int argc, char** argv){
 }
 
 bool ArgumentHolder::Parse(std::vector<std::string>& args){
+    if(args.size() < 2){
+        return false;
+    }
+
+    // A shard worker scans a single directory: --shard-worker=<index>/<count> <dir> [options]
+    unsigned int firstOption = 2;
+    if(args[0].compare(0, 15, "--shard-worker=") == 0){
+        std::string shard = args[0].substr(15);
+        size_t separator = shard.find('/');
+        long index = 0, count = 0;
+        if(separator == std::string::npos
+            || !parseSize(shard.substr(0, separator), index)
+            || !parseSize(shard.substr(separator + 1), count)
+            || index >= count){
+            return false;
+        }
+
+        this->IsShardWorker = true;
+        this->ShardIndex = index;
+        this->ShardCount = count;
+        args[0] = args[1];
+    }
+
     fs::path pathA(args[0]), pathB(args[1]);
     
     // Paths coming in as "/a/b/../" or "/a/." will be converted to "/a"
     // HACK: Boost fs doesn't correctly normalize paths, it's not consistent
     //       So we attach a "file" and use parent_path to obtain a consistent form
-    this->DirectoryA = (pathA/"x").normalize().parent_path();
-    this->DirectoryB = (pathB/"x").normalize().parent_path();
+    auto normalize = [](const fs::path& path){ return (path/"x").normalize().parent_path(); };
+    this->DirectoryA = normalize(pathA);
+    this->DirectoryB = normalize(pathB);
+    this->Directories = {this->DirectoryA, this->DirectoryB};
 
     std::unordered_set<std::string> hashOptions = {"--md5", "--crc32", "--adler32", "--sha1", "--sha256"};
     bool hasHashOption = false;
     std::string checksumName;
-    for(unsigned int i=2; i < args.size() ; i++){
+    std::vector<std::string> scanPrefixes = {"--io-order=", "--io-batch=", "--hash-threads=", "--read-policy=",
+        "--direct-threshold=", "--no-inode-dedupe", "--shard-by=", "--include=", "--exclude=", "--ignore-file=",
+        "--auto-tune", "--tune-window="};
+    for(unsigned int i=firstOption; i < args.size() ; i++){
         std::string& arg = args[i];
 
+        // Any further directory is another replica of the primary (first) directory
+        if(!arg.empty() && arg[0] != '-' && !this->IsShardWorker){
+            this->Directories.push_back(normalize(fs::path(arg)));
+            continue;
+        }
+
         // Check for ignore unchanged files flag
         if(arg == "--ignore-unchanged" || arg == "-u"){
             this->ShouldIgnoreUnchanged = true;
         }
 
+        // Check for the yes/no comparison mode
+        if(arg == "--check"){
+            this->CheckOnly = true;
+        }
+
+        // Check for move detection and the memory it may use
+        if(arg == "--detect-moves"){
+            this->ShouldDetectMoves = true;
+        }
+        else if(arg.compare(0, 14, "--move-memory=") == 0){
+            if(!parseSize(arg.substr(14), this->Options.MoveJoinMemory) || this->Options.MoveJoinMemory == 0){
+                return false;
+            }
+        }
+
+        // Check for the live metrics endpoint
+        if(arg.compare(0, 10, "--metrics=") == 0){
+            this->MetricsEndpoint = arg.substr(10);
+            if(this->MetricsEndpoint.empty()){
+                return false;
+            }
+        }
+
+        // Check for the block-level delta of conflicts, optionally with the side file to write
+        if(arg == "--delta"){
+            this->DeltaFile = "reference.delta";
+        }
+        else if(arg.compare(0, 8, "--delta=") == 0){
+            this->DeltaFile = arg.substr(8);
+            if(this->DeltaFile.empty()){
+                return false;
+            }
+        }
+        this->Options.ComputeDeltas = !this->DeltaFile.empty();
+
+        // Check for the persisted scans
+        if(arg.compare(0, 13, "--scan-cache=") == 0){
+            this->Options.ScanCacheDirectory = arg.substr(13);
+            if(this->Options.ScanCacheDirectory.empty()){
+                return false;
+            }
+        }
+
+        // Check for the compressed patch output, optionally with the compression level
+        if(arg == "--compress"){
+            this->Options.PatchCompression = 1;
+        }
+        else if(arg.compare(0, 11, "--compress=") == 0){
+            if(!parseSize(arg.substr(11), this->Options.PatchCompression)
+                || this->Options.PatchCompression < 1 || this->Options.PatchCompression > 9){
+                return false;
+            }
+        }
+
+        // Check for the external memory mode
+        if(arg.compare(0, 16, "--memory-budget=") == 0){
+            if(!parseSize(arg.substr(16), this->Options.MemoryBudget)){
+                return false;
+            }
+        }
+        else if(arg.compare(0, 11, "--temp-dir=") == 0){
+            this->Options.TempDirectory = arg.substr(11);
+        }
+
+        // Check for the sharded multi-process scan
+        if(arg.compare(0, 9, "--shards=") == 0){
+            long count = 0;
+            if(!parseSize(arg.substr(9), count) || this->IsShardWorker){
+                return false;
+            }
+
+            this->ShardCount = count;
+        }
+        else if(arg.compare(0, 17, "--shard-launcher=") == 0){
+            this->ShardLauncher = arg.substr(17);
+        }
+        else if(arg == "--shard-by=toplevel"){
+            this->Options.ShardBy = ShardMode::TOPLEVEL;
+        }
+        else if(arg == "--shard-by=hash"){
+            this->Options.ShardBy = ShardMode::HASH;
+        }
+        else if(arg.compare(0, 11, "--shard-by=") == 0){
+            return false;
+        }
+
+        // Remember what shard workers have to scan the same way
+        for(auto& prefix : scanPrefixes){
+            if(arg.compare(0, prefix.length(), prefix) == 0){
+                this->ScanOptions.push_back(arg);
+            }
+        }
+
+        // Check for the head/tail prefilter, optionally with a sample size
+        if(arg == "--prefilter"){
+            this->Options.PrefilterBytes = 4096;
+        }
+        else if(arg.compare(0, 12, "--prefilter=") == 0){
+            if(!parseSize(arg.substr(12), this->Options.PrefilterBytes)){
+                return false;
+            }
+        }
+
+        // Check for the hash stage scheduling options
+        if(arg.compare(0, 11, "--io-order=") == 0){
+            std::string order = arg.substr(11);
+            if(order == "walk"){
+                this->Options.ReadOrder = IoOrder::WALK;
+            }
+            else if(order == "inode"){
+                this->Options.ReadOrder = IoOrder::INODE;
+            }
+            else if(order == "extent"){
+                this->Options.ReadOrder = IoOrder::EXTENT;
+            }
+            else{
+                return false;
+            }
+        }
+        else if(arg.compare(0, 11, "--io-batch=") == 0){
+            if(!parseSize(arg.substr(11), this->Options.BatchWindow)){
+                return false;
+            }
+        }
+        else if(arg.compare(0, 15, "--hash-threads=") == 0){
+            if(!parseSize(arg.substr(15), this->Options.HashThreads) || this->Options.HashThreads == 0){
+                return false;
+            }
+        }
+
+        // Check for the auto-tuned hash stage, optionally with its highest number of reads in flight
+        if(arg == "--auto-tune"){
+            this->Options.AutoTune = true;
+        }
+        else if(arg.compare(0, 12, "--auto-tune=") == 0){
+            if(!parseSize(arg.substr(12), this->Options.TuneMaxThreads) || this->Options.TuneMaxThreads == 0){
+                return false;
+            }
+            this->Options.AutoTune = true;
+        }
+        else if(arg.compare(0, 14, "--tune-window=") == 0){
+            if(!parseSize(arg.substr(14), this->Options.TuneWindowMilliseconds) || this->Options.TuneWindowMilliseconds == 0){
+                return false;
+            }
+        }
+
+        // Check for the page cache policy of the hash stage
+        if(arg.compare(0, 14, "--read-policy=") == 0){
+            std::string policy = arg.substr(14);
+            if(policy == "default"){
+                this->Options.CachePolicy = ReadPolicy::DEFAULT;
+            }
+            else if(policy == "sequential"){
+                this->Options.CachePolicy = ReadPolicy::SEQUENTIAL;
+            }
+            else if(policy == "dropbehind"){
+                this->Options.CachePolicy = ReadPolicy::DROPBEHIND;
+            }
+            else if(policy == "direct"){
+                this->Options.CachePolicy = ReadPolicy::DIRECT;
+            }
+            else{
+                return false;
+            }
+        }
+        else if(arg.compare(0, 19, "--direct-threshold=") == 0){
+            if(!parseSize(arg.substr(19), this->Options.DirectThreshold)){
+                return false;
+            }
+        }
+        else if(arg == "--io-report"){
+            this->Options.ReportPageCache = true;
+        }
+
+        // Check for include/exclude patterns, applied in the order given
+        if(arg.compare(0, 10, "--include=") == 0){
+            this->Options.Filter.Include(arg.substr(10));
+        }
+        else if(arg.compare(0, 10, "--exclude=") == 0){
+            this->Options.Filter.Exclude(arg.substr(10));
+        }
+        else if(arg.compare(0, 14, "--ignore-file=") == 0){
+            if(!this->Options.Filter.LoadIgnoreFile(arg.substr(14))){
+                return false;
+            }
+        }
+
+        // Check for hardlink dedupe being turned off
+        if(arg == "--no-inode-dedupe"){
+            this->Options.DedupeInodes = false;
+        }
+
         // Check for a hash selection
         auto entry = hashOptions.find(arg);
         if(entry != hashOptions.end()){
@@ -65,31 +288,34 @@ bool ArgumentHolder::Parse(std::vector<std::string>& args){
 
             checksumName = (*entry).substr(2);
             hasHashOption = true;
+            this->ScanOptions.push_back(arg);
         }
     }
 
+    // The external memory and sharded reconciles stream a single pair of directories
+    bool streamed = this->Options.MemoryBudget > 0 || (this->ShardCount > 0 && !this->IsShardWorker);
+    if(streamed && (this->Directories.size() > 2 || this->ShouldDetectMoves || this->Options.ComputeDeltas
+        || !this->Options.ScanCacheDirectory.empty())){
+        return false;
+    }
+
     this->setHash(checksumName);
     return true;
 }
 
-void ArgumentHolder::setHash(std::string hashName){
-    // Not very elegant, but simple
-    if(hashName == "md5"){
-        // Default option
-        return;
-    }
-    else if(hashName == "crc32"){
-        this->Checksum = checksum_ptr( new CryptoPP::CRC32());
+bool ArgumentHolder::parseSize(const std::string& text, long& value){
+    try{
+        size_t consumed = 0;
+        value = std::stol(text, &consumed);
+        return consumed == text.length() && value >= 0;
     }
-    else if(hashName == "adler32"){
-        this->Checksum = checksum_ptr( new CryptoPP::Adler32());
-    }
-    else if(hashName == "sha1"){
-        this->Checksum = checksum_ptr( new CryptoPP::SHA1());
-    }
-    else if(hashName == "sha256"){
-        this->Checksum = checksum_ptr( new CryptoPP::SHA256());
+    catch(const std::exception&){
+        return false;
     }
 }
 
-#undef CRYPTOPP_ENABLE_NAMESPACE_WEAK
\ No newline at end of file
+void ArgumentHolder::setHash(std::string hashName){
+    if(!hashName.empty()){
+        this->Checksum = CreateChecksum(hashName);
+    }
+}
@@ -1,24 +1,52 @@
 #pragma once
 
-#include <cryptopp/cryptlib.h>
 #include <vector>
 #include <string>
 
 #include <boost/filesystem.hpp>
 
-namespace fs = boost::filesystem;
+#include "checksum.hpp"
+#include "worker_options.hpp"
 
-typedef std::shared_ptr<CryptoPP::HashTransformation> checksum_ptr;
+namespace fs = boost::filesystem;
 
 struct ArgumentHolder{
     fs::path DirectoryA;
 
     fs::path DirectoryB;
 
+    // Every directory given, the primary first followed by its replicas (DirectoryA, DirectoryB, ...)
+    std::vector<fs::path> Directories;
+
     checksum_ptr Checksum;
 
     bool ShouldIgnoreUnchanged;
 
+    bool CheckOnly;
+
+    bool ShouldDetectMoves;
+
+    // Localhost port or Unix socket path serving live metrics, empty when not wanted
+    std::string MetricsEndpoint;
+
+    // Side file receiving the block-level delta of every conflict, empty when not wanted
+    std::string DeltaFile;
+
+    // Number of shard worker processes per directory, 0 scans in this process
+    size_t ShardCount;
+
+    // Command prefix starting a shard worker elsewhere, empty for local processes
+    std::string ShardLauncher;
+
+    // Set when this process is the worker of shard ShardIndex out of ShardCount, scanning DirectoryA
+    bool IsShardWorker;
+    size_t ShardIndex;
+
+    // Options affecting the scan itself, handed down to shard workers
+    std::vector<std::string> ScanOptions;
+
+    WorkerOptions Options;
+
     ArgumentHolder();
 
     // Parse the arguments given
@@ -27,4 +55,7 @@ struct ArgumentHolder{
 
 private:
     void setHash(std::string hashName);
+
+    // Parse a non-negative numeric option value
+    static bool parseSize(const std::string& text, long& value);
 };
\ No newline at end of file
@@ -0,0 +1,75 @@
+// Throughput of the CRC32 and Adler32 checksums: Crypto++ against the kernels of fast_checksum.hpp
+//
+// Build from the c++ directory:
+//   clang++ -std=c++17 -O3 -DNDEBUG bench/checksum_bench.cpp fast_checksum.cpp -I. -lcryptopp -o checksum_bench.out
+// Run with an optional buffer size in MiB [256]:
+//   ./checksum_bench.out 1024
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <cryptopp/adler32.h>
+#include <cryptopp/crc.h>
+
+#include "fast_checksum.hpp"
+
+namespace{
+    // Best of a few passes over the buffer, fed in 1MiB chunks like the hash stage does
+    double throughput(CryptoPP::HashTransformation& checksum, const std::vector<unsigned char>& buffer, std::string& digest){
+        const size_t chunk = 1024 * 1024;
+        double best = 0;
+
+        for(int pass = 0; pass < 5; pass++){
+            auto started = std::chrono::steady_clock::now();
+            for(size_t offset = 0; offset < buffer.size(); offset += chunk){
+                checksum.Update(buffer.data() + offset, std::min(chunk, buffer.size() - offset));
+            }
+
+            digest.assign(checksum.DigestSize(), '\0');
+            checksum.Final((unsigned char*)&digest[0]);
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            best = std::max(best, buffer.size() / seconds / (1024 * 1024 * 1024));
+        }
+
+        return best;
+    }
+
+    bool compare(const char* name, CryptoPP::HashTransformation& reference, CryptoPP::HashTransformation& fast,
+        const char* implementation, const std::vector<unsigned char>& buffer){
+        std::string referenceDigest, fastDigest;
+        double referenceSpeed = throughput(reference, buffer, referenceDigest);
+        double fastSpeed = throughput(fast, buffer, fastDigest);
+
+        std::cout << name << ": Crypto++ " << referenceSpeed << " GiB/s, " << implementation << " "
+            << fastSpeed << " GiB/s (x" << fastSpeed / referenceSpeed << ")"
+            << (referenceDigest == fastDigest ? "" : ", DIGESTS DIFFER") << std::endl;
+
+        return referenceDigest == fastDigest;
+    }
+}
+
+int main(int argc, char** argv){
+    size_t mebibytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    std::vector<unsigned char> buffer(mebibytes * 1024 * 1024);
+
+    std::mt19937_64 random(42);
+    for(auto& value : buffer){
+        value = (unsigned char)random();
+    }
+
+    CryptoPP::CRC32 referenceCrc;
+    CryptoPP::Adler32 referenceAdler;
+    FastCRC32 fastCrc;
+    FastAdler32 fastAdler;
+
+    bool crcMatches = compare("CRC32", referenceCrc, fastCrc, FastCRC32::Implementation(), buffer);
+    bool adlerMatches = compare("Adler32", referenceAdler, fastAdler, FastAdler32::Implementation(), buffer);
+
+    return crcMatches && adlerMatches ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+#define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
+
+#include <cstring>
+#include <unordered_map>
+
+#include <cryptopp/md5.h>
+
+#include "block_delta.hpp"
+
+namespace{
+    // Random value of every byte, mixed into the rolling hash
+    struct GearTable{
+        unsigned long long values[256];
+
+        GearTable(){
+            // splitmix64, the table only has to be fixed and well spread
+            unsigned long long state = 0x9E3779B97F4A7C15ULL;
+            for(auto& value : this->values){
+                unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                value = z ^ (z >> 31);
+            }
+        }
+    };
+
+    const GearTable gear;
+
+    struct DigestHasher{
+        size_t operator()(const std::array<unsigned char, 16>& digest) const{
+            size_t value;
+            std::memcpy(&value, digest.data(), sizeof(value));
+            return value;
+        }
+    };
+}
+
+ContentChunker::ContentChunker()
+: digest(std::make_shared<CryptoPP::Weak::MD5>()), offset(0), chunkLength(0), rolling(0) {}
+
+void ContentChunker::cut(){
+    ContentChunk chunk;
+    chunk.offset = this->offset;
+    chunk.length = this->chunkLength;
+    this->digest->Final(chunk.digest.data());
+    this->chunks.push_back(chunk);
+
+    this->offset += this->chunkLength;
+    this->chunkLength = 0;
+    this->rolling = 0;
+}
+
+void ContentChunker::Update(const unsigned char* data, size_t length){
+    size_t start = 0;
+    for(size_t i = 0; i < length; i++){
+        this->rolling = (this->rolling << 1) + gear.values[data[i]];
+        this->chunkLength++;
+
+        if((this->chunkLength >= minimumChunk && (this->rolling >> (64 - averageBits)) == 0)
+            || this->chunkLength >= maximumChunk){
+            this->digest->Update(data + start, i + 1 - start);
+            this->cut();
+            start = i + 1;
+        }
+    }
+
+    this->digest->Update(data + start, length - start);
+}
+
+chunk_list ContentChunker::Finish(){
+    if(this->chunkLength > 0){
+        this->cut();
+    }
+
+    return std::move(this->chunks);
+}
+
+delta_ranges ComputeDelta(const chunk_list& source, const chunk_list& target){
+    // First offset of every chunk content in the source
+    std::unordered_map<std::array<unsigned char, 16>, const ContentChunk*, DigestHasher> known;
+    known.reserve(source.size());
+    for(auto& chunk : source){
+        known.emplace(chunk.digest, &chunk);
+    }
+
+    delta_ranges ranges;
+    for(auto& chunk : target){
+        auto match = known.find(chunk.digest);
+        bool matched = match != known.end() && match->second->length == chunk.length;
+        unsigned long long sourceOffset = matched ? match->second->offset : 0;
+
+        // Extend the previous range when this chunk continues it, in the target and for matches in the source too
+        if(!ranges.empty() && ranges.back().matched == matched
+            && (!matched || ranges.back().sourceOffset + ranges.back().length == sourceOffset)){
+            ranges.back().length += chunk.length;
+        }
+        else{
+            ranges.push_back(DeltaRange{chunk.offset, chunk.length, matched, sourceOffset});
+        }
+    }
+
+    return ranges;
+}
+
+void WriteDelta(std::ostream& out, const std::string& filepath, long sourceSize, long targetSize, const delta_ranges& ranges){
+    unsigned long long matchedBytes = 0;
+    for(auto& range : ranges){
+        matchedBytes += range.matched ? range.length : 0;
+    }
+
+    out << "! " << filepath << " (" << sourceSize << " -> " << targetSize << " bytes, "
+        << matchedBytes << " matched, " << targetSize - matchedBytes << " changed)" << std::endl;
+
+    for(auto& range : ranges){
+        if(range.matched){
+            out << "  = " << range.offset << " " << range.length << " <= " << range.sourceOffset << std::endl;
+        }
+        else{
+            out << "  + " << range.offset << " " << range.length << std::endl;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include <cryptopp/cryptlib.h>
+
+// A content-defined chunk of a file and the strong digest of its bytes
+struct ContentChunk{
+    unsigned long long offset;
+    unsigned int length;
+    std::array<unsigned char, 16> digest;
+};
+
+typedef std::vector<ContentChunk> chunk_list;
+
+// Cuts a byte stream into content-defined chunks with a gear rolling hash, so that an insertion
+// or a removal only changes the chunks around it. Chunks are 2KiB to 64KiB, 8KiB on average
+class ContentChunker{
+private:
+    static const unsigned int minimumChunk = 2 * 1024;
+    static const unsigned int maximumChunk = 64 * 1024;
+
+    // A boundary is cut when the top averageBits bits of the rolling hash are all zero
+    static const unsigned int averageBits = 13;
+
+    std::shared_ptr<CryptoPP::HashTransformation> digest;
+    chunk_list chunks;
+    unsigned long long offset;
+    unsigned int chunkLength;
+    unsigned long long rolling;
+
+    // Ends the current chunk
+    void cut();
+
+public:
+    ContentChunker();
+
+    // Feeds the next bytes of the stream
+    void Update(const unsigned char* data, size_t length);
+
+    // Ends the stream and hands over its chunks
+    chunk_list Finish();
+};
+
+// A range of the target file, either found at sourceOffset in the source file or changed
+struct DeltaRange{
+    unsigned long long offset;
+    unsigned long long length;
+    bool matched;
+    unsigned long long sourceOffset;
+};
+
+typedef std::vector<DeltaRange> delta_ranges;
+
+// Describes the target file in ranges of the source file and changed ranges, adjacent ranges are coalesced
+delta_ranges ComputeDelta(const chunk_list& source, const chunk_list& target);
+
+// Writes the summary of one file: a header line, then '=' matched and '+' changed ranges
+void WriteDelta(std::ostream& out, const std::string& filepath, long sourceSize, long targetSize, const delta_ranges& ranges);
@@ -0,0 +1,31 @@
+#define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
+
+#include <cryptopp/cryptlib.h>
+#include <cryptopp/md5.h>
+#include <cryptopp/sha.h>
+
+#include "checksum.hpp"
+#include "fast_checksum.hpp"
+
+checksum_ptr CreateChecksum(std::string hashName){
+    // Not very elegant, but simple
+    if(hashName == "md5"){
+        return checksum_ptr( new CryptoPP::Weak::MD5());
+    }
+    else if(hashName == "crc32"){
+        return checksum_ptr( new FastCRC32());
+    }
+    else if(hashName == "adler32"){
+        return checksum_ptr( new FastAdler32());
+    }
+    else if(hashName == "sha1"){
+        return checksum_ptr( new CryptoPP::SHA1());
+    }
+    else if(hashName == "sha256"){
+        return checksum_ptr( new CryptoPP::SHA256());
+    }
+
+    return nullptr;
+}
+
+#undef CRYPTOPP_ENABLE_NAMESPACE_WEAK
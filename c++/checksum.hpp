@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cryptopp/cryptlib.h>
+#include <memory>
+#include <string>
+
+typedef std::shared_ptr<CryptoPP::HashTransformation> checksum_ptr;
+
+// Creates the checksum of the given name (md5, crc32, adler32, sha1, sha256), null for an unknown name
+checksum_ptr CreateChecksum(std::string hashName);
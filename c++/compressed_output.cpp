@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#include <zlib.h>
+
+#include "compressed_output.hpp"
+
+CompressedBuffer::CompressedBuffer(const std::string& path, int level, unsigned int threads, size_t blockSize)
+: level(level), blockSize(blockSize), failed(false), bytesIn(0), bytesOut(0), pool(threads) {
+    this->file = std::fopen(path.c_str(), "wb");
+    this->failed = this->file == nullptr;
+
+    // Enough blocks in flight to keep every thread busy while the front one is being written
+    this->maxInFlight = 2 * (size_t)this->pool.Size();
+
+    this->current.resize(blockSize);
+    this->setp(this->current.data(), this->current.data() + this->current.size());
+}
+
+CompressedBuffer::~CompressedBuffer(){
+    this->Close();
+}
+
+bool CompressedBuffer::compress(const int level, Block& block){
+    z_stream stream = {};
+
+    // A window of 15 bits plus 16 asks zlib for a gzip header and trailer
+    if(deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK){
+        return false;
+    }
+
+    block.output.resize(deflateBound(&stream, block.input.size()));
+    stream.next_in = (Bytef*)block.input.data();
+    stream.avail_in = (uInt)block.input.size();
+    stream.next_out = (Bytef*)&block.output[0];
+    stream.avail_out = (uInt)block.output.size();
+
+    int status = deflate(&stream, Z_FINISH);
+    block.output.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    return status == Z_STREAM_END;
+}
+
+bool CompressedBuffer::submit(){
+    size_t filled = this->pptr() - this->pbase();
+    if(filled == 0){
+        return !this->failed;
+    }
+
+    auto block = std::make_shared<Block>();
+    block->input.assign(this->pbase(), this->pptr());
+    this->bytesIn += filled;
+    this->setp(this->current.data(), this->current.data() + this->current.size());
+
+    // With the window full the writer compresses the block itself rather than waiting,
+    // so formatting slows down to the combined speed instead of stalling on the pool
+    bool full;
+    {
+        std::lock_guard<std::mutex> guard(this->blocksLock);
+        full = this->inFlight.size() >= this->maxInFlight;
+        this->inFlight.push_back(block);
+    }
+
+    if(full){
+        bool compressed = compress(this->level, *block);
+        std::lock_guard<std::mutex> guard(this->blocksLock);
+        this->failed = this->failed || !compressed;
+        block->done = true;
+    }
+    else{
+        int level = this->level;
+        this->pool.Post([this, block, level]{
+            bool compressed = compress(level, *block);
+            {
+                std::lock_guard<std::mutex> guard(this->blocksLock);
+                this->failed = this->failed || !compressed;
+                block->done = true;
+            }
+            this->blockDone.notify_all();
+        });
+    }
+
+    return this->writeFinished(full);
+}
+
+bool CompressedBuffer::writeFinished(bool wait){
+    std::unique_lock<std::mutex> guard(this->blocksLock);
+    while(!this->inFlight.empty()){
+        if(!this->inFlight.front()->done){
+            if(!wait){
+                break;
+            }
+
+            this->blockDone.wait(guard, [this]{ return this->inFlight.front()->done; });
+        }
+
+        auto block = this->inFlight.front();
+        this->inFlight.pop_front();
+        wait = false;
+
+        // Only the writer pops blocks, the order can't change while the lock is released
+        guard.unlock();
+        if(this->file != nullptr && std::fwrite(block->output.data(), 1, block->output.size(), this->file) != block->output.size()){
+            this->failed = true;
+        }
+        this->bytesOut += block->output.size();
+        guard.lock();
+    }
+
+    return !this->failed;
+}
+
+CompressedBuffer::int_type CompressedBuffer::overflow(int_type ch){
+    if(!this->submit()){
+        return traits_type::eof();
+    }
+
+    if(!traits_type::eq_int_type(ch, traits_type::eof())){
+        *this->pptr() = traits_type::to_char_type(ch);
+        this->pbump(1);
+    }
+
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize CompressedBuffer::xsputn(const char* data, std::streamsize count){
+    std::streamsize written = 0;
+    while(written < count){
+        if(this->pptr() == this->epptr() && !this->submit()){
+            break;
+        }
+
+        std::streamsize room = std::min<std::streamsize>(count - written, this->epptr() - this->pptr());
+        std::memcpy(this->pptr(), data + written, room);
+        this->pbump((int)room);
+        written += room;
+    }
+
+    return written;
+}
+
+bool CompressedBuffer::Close(){
+    if(this->file == nullptr){
+        return !this->failed;
+    }
+
+    this->submit();
+    {
+        std::unique_lock<std::mutex> guard(this->blocksLock);
+        this->blockDone.wait(guard, [this]{
+            return std::all_of(this->inFlight.begin(), this->inFlight.end(), [](const std::shared_ptr<Block>& block){ return block->done; });
+        });
+    }
+    this->writeFinished(false);
+
+    this->failed = std::fclose(this->file) != 0 || this->failed;
+    this->file = nullptr;
+    return !this->failed;
+}
+
+bool CompressedBuffer::IsOpen() const{
+    return this->file != nullptr;
+}
+
+unsigned long long CompressedBuffer::BytesIn() const{
+    return this->bytesIn;
+}
+
+unsigned long long CompressedBuffer::BytesOut() const{
+    return this->bytesOut;
+}
+
+CompressedOutput::CompressedOutput(const std::string& path, int level)
+: std::ostream(nullptr), buffer(path, level, std::max(std::thread::hardware_concurrency(), 1u)) {
+    this->rdbuf(&this->buffer);
+    if(!this->buffer.IsOpen()){
+        this->setstate(std::ios_base::badbit);
+    }
+}
+
+void CompressedOutput::close(){
+    if(!this->buffer.Close()){
+        this->setstate(std::ios_base::badbit);
+    }
+}
+
+unsigned long long CompressedOutput::BytesIn() const{
+    return this->buffer.BytesIn();
+}
+
+unsigned long long CompressedOutput::BytesOut() const{
+    return this->buffer.BytesOut();
+}
+
+std::unique_ptr<std::ostream> OpenPatchOutput(const std::string& destination, int level){
+    if(level == 0){
+        return std::unique_ptr<std::ostream>(new std::ofstream(destination));
+    }
+
+    return std::unique_ptr<std::ostream>(new CompressedOutput(destination, level));
+}
+
+PatchSize ClosePatchOutput(std::ostream& output, const std::string& destination){
+    PatchSize size;
+    output.flush();
+
+    // A full disk may only show up on the last blocks or when the file is closed
+    if(auto compressed = dynamic_cast<CompressedOutput*>(&output)){
+        compressed->close();
+        size.Text = compressed->BytesIn();
+        size.Stored = compressed->BytesOut();
+    }
+    else if(auto plain = dynamic_cast<std::ofstream*>(&output)){
+        std::streamoff written = plain->tellp();
+        size.Text = size.Stored = written > 0 ? (unsigned long long)written : 0;
+        plain->close();
+    }
+
+    if(!output){
+        throw std::runtime_error("Unable to write the patch '" + destination + "'");
+    }
+
+    return size;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+// Stream buffer cutting what is written into fixed-size blocks, each compressed on a thread pool into an
+// independent gzip member. Members are written in order, so the file is a plain multi-member gzip stream
+// that 'zcat' or any zlib reader decodes incrementally
+class CompressedBuffer : public std::streambuf{
+private:
+    // A block on its way to the file
+    struct Block{
+        std::vector<char> input;
+        std::string output;
+        bool done = false;
+    };
+
+    std::FILE* file;
+    const int level;
+    const size_t blockSize;
+
+    // Block being filled by the writer
+    std::vector<char> current;
+
+    // Submitted blocks in file order, at most maxInFlight of them
+    std::deque<std::shared_ptr<Block>> inFlight;
+    size_t maxInFlight;
+    std::mutex blocksLock;
+    std::condition_variable blockDone;
+
+    std::atomic<bool> failed;
+    unsigned long long bytesIn;
+    unsigned long long bytesOut;
+
+    ThreadPool pool;
+
+    // Compresses a whole block into a single gzip member
+    static bool compress(const int level, Block& block);
+
+    // Hands the filled part of the current block over and starts a new one
+    bool submit();
+
+    // Writes the finished blocks at the front, waiting for the front one when wait is set
+    bool writeFinished(bool wait);
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* data, std::streamsize count) override;
+
+public:
+    // ctor w/ the destination, the zlib level (1-9), the compressing threads and the uncompressed block size
+    CompressedBuffer(const std::string& path, int level, unsigned int threads, size_t blockSize = 1024 * 1024);
+
+    // Closes the file if that wasn't done yet
+    ~CompressedBuffer();
+
+    CompressedBuffer(const CompressedBuffer&) = delete;
+    CompressedBuffer& operator=(const CompressedBuffer&) = delete;
+
+    // Compresses and writes the remaining blocks, returns false if the file couldn't be written
+    bool Close();
+
+    // Whether the file was created and not closed yet
+    bool IsOpen() const;
+
+    // Bytes written to the stream so far, and bytes of compressed output written to the file
+    unsigned long long BytesIn() const;
+    unsigned long long BytesOut() const;
+};
+
+// Output stream over a CompressedBuffer, bad when the file can't be created
+class CompressedOutput : public std::ostream{
+private:
+    CompressedBuffer buffer;
+
+public:
+    // ctor w/ the destination and the zlib level, compressing on as many threads as the hardware has
+    CompressedOutput(const std::string& path, int level);
+
+    // Finishes the file, setting badbit if it couldn't be written
+    void close();
+
+    // Bytes written to the stream, and bytes of compressed output written to the file
+    unsigned long long BytesIn() const;
+    unsigned long long BytesOut() const;
+};
+
+// Size of a finished patch: the text written, and what it takes in the file once compressed
+struct PatchSize{
+    unsigned long long Text = 0;
+    unsigned long long Stored = 0;
+};
+
+// Opens a patch destination: a plain file when level is 0, a compressed one otherwise
+std::unique_ptr<std::ostream> OpenPatchOutput(const std::string& destination, int level);
+
+// Flushes and closes a destination opened by OpenPatchOutput, throws if any of the patch couldn't be written
+PatchSize ClosePatchOutput(std::ostream& output, const std::string& destination);
@@ -0,0 +1,106 @@
+#include <algorithm>
+
+#include "concurrency_controller.hpp"
+
+ConcurrencyKnob::ConcurrencyKnob(std::string name, unsigned int initial, unsigned int minimum, unsigned int maximum)
+: name(name), minimum(minimum), maximum(maximum), limit(std::min(std::max(initial, minimum), maximum)),
+  bestLimit(limit) {}
+
+void ConcurrencyKnob::Record(unsigned long long files, unsigned long long bytes){
+    this->files.fetch_add(files, std::memory_order_relaxed);
+    this->bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void ConcurrencyKnob::SetBacklogged(bool backlogged){
+    this->backlogged.store(backlogged, std::memory_order_relaxed);
+}
+
+void ConcurrencyKnob::Retire(){
+    this->retired = true;
+}
+
+ConcurrencyController::ConcurrencyController(std::chrono::milliseconds window, unsigned int maximum)
+: window(window), maximum(std::max(1u, maximum)), stopping(false) {
+    this->thread = std::thread(&ConcurrencyController::run, this);
+}
+
+ConcurrencyController::~ConcurrencyController(){
+    {
+        std::lock_guard<std::mutex> guard(this->knobsLock);
+        this->stopping = true;
+    }
+    this->stopped.notify_all();
+    this->thread.join();
+}
+
+ConcurrencyKnob* ConcurrencyController::Register(std::string name, unsigned int initial){
+    std::lock_guard<std::mutex> guard(this->knobsLock);
+    this->knobs.emplace_back(new ConcurrencyKnob(name, initial, 1, this->maximum));
+    return this->knobs.back().get();
+}
+
+void ConcurrencyController::run(){
+    std::unique_lock<std::mutex> guard(this->knobsLock);
+    auto last = std::chrono::steady_clock::now();
+
+    while(!this->stopped.wait_for(guard, this->window, [this]{ return this->stopping; })){
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        for(auto& knob : this->knobs){
+            if(!knob->retired){
+                this->adjust(*knob, seconds);
+            }
+        }
+    }
+}
+
+void ConcurrencyController::adjust(ConcurrencyKnob& knob, double seconds){
+    unsigned long long files = knob.files.load(std::memory_order_relaxed);
+    unsigned long long bytes = knob.bytes.load(std::memory_order_relaxed);
+    double score = ((bytes - knob.lastBytes) + (files - knob.lastFiles) * fileCost) / seconds;
+    knob.lastFiles = files;
+    knob.lastBytes = bytes;
+
+    // Without work waiting for a slot the limit made no difference, there is nothing to learn
+    if(!knob.backlogged.load(std::memory_order_relaxed)){
+        knob.lastScore = 0;
+        return;
+    }
+
+    unsigned int limit = knob.Limit();
+    if(score > knob.bestScore){
+        knob.bestScore = score;
+        knob.bestLimit = limit;
+    }
+
+    // The last move made things worse: go back the other way
+    if(knob.lastScore > 0 && score < knob.lastScore * (1 - tolerance)){
+        knob.direction = -knob.direction;
+    }
+    knob.lastScore = score;
+
+    // Small limits move one at a time, large ones by a quarter
+    int step = std::max(1u, limit / 4) * knob.direction;
+    unsigned int next = (unsigned int)std::min(std::max((int)limit + step, (int)knob.minimum), (int)knob.maximum);
+    if(next == limit){
+        knob.direction = -knob.direction;
+        return;
+    }
+
+    knob.limit = next;
+    knob.adjustments++;
+}
+
+// Write the final and best limit of every knob, to be pinned in later runs
+void ConcurrencyController::Print(std::ostream& out){
+    std::lock_guard<std::mutex> guard(this->knobsLock);
+    for(auto& knob : this->knobs){
+        out << "Auto-tune: " << knob->name << " ended at " << knob->Limit() << " in flight";
+        if(knob->bestScore > 0){
+            out << ", best " << knob->bestScore / (1024 * 1024) << " MiB/s equivalent at " << knob->bestLimit;
+        }
+        out << " (" << knob->adjustments << " adjustments)" << std::endl;
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Concurrency limit of one stage of one root, adjusted by a ConcurrencyController
+class ConcurrencyKnob{
+private:
+    friend class ConcurrencyController;
+
+    const std::string name;
+    const unsigned int minimum;
+    const unsigned int maximum;
+    std::atomic<unsigned int> limit;
+
+    // Work completed, and whether work was left waiting for a slot, reported by the stage
+    std::atomic<unsigned long long> files{0};
+    std::atomic<unsigned long long> bytes{0};
+    std::atomic<bool> backlogged{false};
+    std::atomic<bool> retired{false};
+
+    // Hill climbing state, only touched by the controller thread
+    unsigned long long lastFiles = 0;
+    unsigned long long lastBytes = 0;
+    double lastScore = 0;
+    int direction = 1;
+    double bestScore = 0;
+    unsigned int bestLimit;
+    unsigned int adjustments = 0;
+
+public:
+    ConcurrencyKnob(std::string name, unsigned int initial, unsigned int minimum, unsigned int maximum);
+
+    // Work units the stage may have running at once
+    unsigned int Limit() const { return this->limit.load(std::memory_order_relaxed); }
+
+    // Counts completed work
+    void Record(unsigned long long files, unsigned long long bytes);
+
+    // Tells whether work is waiting because the limit is reached, the limit is only judged under load
+    void SetBacklogged(bool backlogged);
+
+    // The stage is done, its knob is no longer adjusted
+    void Retire();
+};
+
+// Hill-climbs the limit of every registered knob toward its best throughput: every window, a knob under load
+// keeps moving its limit in the same direction while throughput holds, and turns back when it drops
+class ConcurrencyController{
+private:
+    // Relative throughput change taken as noise
+    static constexpr double tolerance = 0.05;
+
+    // A file costs about this many bytes of transfer in open and metadata work, so that
+    // small-file and large-file throughput are comparable
+    static const unsigned long long fileCost = 64 * 1024;
+
+    const std::chrono::milliseconds window;
+    const unsigned int maximum;
+
+    std::vector<std::unique_ptr<ConcurrencyKnob>> knobs;
+    std::mutex knobsLock;
+
+    std::thread thread;
+    std::condition_variable stopped;
+    bool stopping;
+
+    // Body of the controller thread
+    void run();
+
+    // One hill climbing step of a knob over the last window
+    void adjust(ConcurrencyKnob& knob, double seconds);
+
+public:
+    // ctor w/ the measurement window and the highest limit a knob may reach
+    ConcurrencyController(std::chrono::milliseconds window, unsigned int maximum);
+
+    // Stops the controller thread
+    ~ConcurrencyController();
+
+    ConcurrencyController(const ConcurrencyController&) = delete;
+    ConcurrencyController& operator=(const ConcurrencyController&) = delete;
+
+    // Adds a knob starting at the initial limit, it lives as long as the controller
+    ConcurrencyKnob* Register(std::string name, unsigned int initial);
+
+    // Write the final and best limit of every knob, to be pinned in later runs
+    void Print(std::ostream& out);
+};
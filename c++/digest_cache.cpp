@@ -0,0 +1,42 @@
+#include "digest_cache.hpp"
+
+std::string DigestCache::Get(const FileKey& key, const std::function<std::string()>& compute, bool& computed){
+    std::promise<std::string> digest;
+    std::shared_future<std::string> claimed;
+    {
+        std::lock_guard<std::mutex> guard(this->digestsLock);
+        auto entry = this->digests.find(key);
+        if(entry != this->digests.end()){
+            claimed = entry->second;
+        }
+        else{
+            this->digests.emplace(key, digest.get_future().share());
+        }
+    }
+
+    if(claimed.valid()){
+        // Someone else claimed this file, wait for their result instead of reading it again
+        computed = false;
+        return claimed.get();
+    }
+
+    computed = true;
+    try{
+        std::string result = compute();
+        if(result.empty()){
+            this->forget(key);
+        }
+        digest.set_value(result);
+        return result;
+    }
+    catch(...){
+        this->forget(key);
+        digest.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+void DigestCache::forget(const FileKey& key){
+    std::lock_guard<std::mutex> guard(this->digestsLock);
+    this->digests.erase(key);
+}
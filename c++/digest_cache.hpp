@@ -0,0 +1,46 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Identity of a physical file
+struct FileKey{
+    unsigned long long device;
+    unsigned long long inode;
+
+    bool operator==(const FileKey& rhs) const{
+        return this->device == rhs.device && this->inode == rhs.inode;
+    }
+};
+
+namespace std
+{
+    template<> struct hash<FileKey>
+    {
+        typedef FileKey argument_type;
+        typedef std::size_t result_type;
+        result_type operator()(argument_type const& key) const noexcept
+        {
+            return std::hash<unsigned long long>()(key.inode * 31 + key.device);
+        }
+    };
+}
+
+// Concurrent (device, inode) -> digest map, each physical file is hashed once
+class DigestCache{
+private:
+    std::mutex digestsLock;
+    std::unordered_map<FileKey, std::shared_future<std::string>> digests;
+
+    // Drops the entry of a file whose digest couldn't be computed
+    void forget(const FileKey& key);
+
+public:
+    // Returns the digest of the file, running compute unless another caller already did or is doing it.
+    // computed tells whether this call did the work. An empty digest (an interrupted read) or an exception
+    // reaches the callers already waiting but isn't kept, the next caller computes the digest again
+    std::string Get(const FileKey& key, const std::function<std::string()>& compute, bool& computed);
+};
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "external_reconcile.hpp"
+#include "worker.hpp"
+#include "utils.hpp"
+#include "compressed_output.hpp"
+
+namespace fs = boost::filesystem;
+
+TempFiles::~TempFiles(){
+    for(auto& path : this->paths){
+        boost::system::error_code ignored;
+        fs::remove(path, ignored);
+    }
+}
+
+std::string TempFiles::Create(const std::string& tempDir, const std::string& pattern){
+    std::string path = (fs::path(tempDir) / fs::unique_path(pattern)).string();
+
+    std::lock_guard<std::mutex> guard(this->pathsLock);
+    this->paths.push_back(path);
+    return path;
+}
+
+std::vector<std::string> ReduceRuns(std::vector<std::string> runs, size_t fanIn, TempFiles& temporaries,
+    const std::string& tempDir, unsigned long long& merges){
+    fanIn = std::max<size_t>(fanIn, 2);
+
+    while(runs.size() > fanIn){
+        std::vector<std::string> reduced;
+        for(size_t first = 0; first < runs.size(); first += fanIn){
+            size_t last = std::min(first + fanIn, runs.size());
+            if(last - first == 1){
+                reduced.push_back(runs[first]);
+                continue;
+            }
+
+            std::string merged = temporaries.Create(tempDir, "merge-%%%%-%%%%-%%%%.run");
+            std::FILE* stream = std::fopen(merged.c_str(), "wb");
+            if(!stream){
+                throw std::runtime_error("Unable to create run '" + merged + "'");
+            }
+
+            auto source = OpenRuns(std::vector<std::string>(runs.begin() + first, runs.begin() + last));
+            FileResult record;
+            bool written = true;
+            while(written && source->Next(record)){
+                written = WriteRecord(stream, record);
+            }
+
+            if(std::fclose(stream) != 0 || !written){
+                throw std::runtime_error("Unable to write run '" + merged + "'");
+            }
+
+            reduced.push_back(merged);
+            merges++;
+        }
+
+        runs.swap(reduced);
+    }
+
+    return runs;
+}
+
+std::unique_ptr<RecordSource> OpenRuns(const std::vector<std::string>& runs){
+    std::vector<std::unique_ptr<RecordSource>> sources;
+    for(auto& run : runs){
+        sources.emplace_back(new RecordReader(run));
+    }
+
+    return std::unique_ptr<RecordSource>(new MergedRecords(std::move(sources)));
+}
+
+PatchSize WriteStreamedResult(RecordSource& a, RecordSource& b, const std::string& dirA, const std::string& dirB,
+    const std::string& destination, bool ignoreUnchanged, const std::string& tempDir, int compressLevel){
+    // Both sections come out of the merge in path order, the second one waits in a temporary file
+    TempFiles temporaries;
+    std::string sectionPath = temporaries.Create(tempDir, "section-%%%%-%%%%-%%%%.patch");
+
+    auto outFile = OpenPatchOutput(destination, compressLevel);
+    std::fstream sectionB (sectionPath, std::fstream::out);
+
+    *outFile << "# Results for " << GetFormattedDateTime() << std::endl;
+    *outFile << "# Reconciled '" << dirA << "' '" << dirB << "'" << std::endl;
+    *outFile << dirA << std::endl;
+    sectionB << dirB << std::endl;
+
+    auto writeLine = [ignoreUnchanged](std::ostream& section, ReconcileOperation operation, FileResult& entry){
+        if(operation == ReconcileOperation::UNCHANGED && ignoreUnchanged){
+            return;
+        }
+
+        section << (char)operation << " " << entry.toString() << "\n";
+    };
+
+    FileResult recordA, recordB;
+    bool hasA = a.Next(recordA), hasB = b.Next(recordB);
+    while(hasA || hasB){
+        if(hasA && (!hasB || recordA.filepath < recordB.filepath)){
+            writeLine(sectionB, ReconcileOperation::ADD, recordA);
+            hasA = a.Next(recordA);
+        }
+        else if(hasB && (!hasA || recordB.filepath < recordA.filepath)){
+            writeLine(*outFile, ReconcileOperation::ADD, recordB);
+            hasB = b.Next(recordB);
+        }
+        else{
+            auto operation = recordA == recordB ? ReconcileOperation::UNCHANGED : ReconcileOperation::CONFLICT;
+            writeLine(*outFile, operation, recordA);
+            writeLine(sectionB, operation, recordB);
+            hasA = a.Next(recordA);
+            hasB = b.Next(recordB);
+        }
+    }
+
+    sectionB.close();
+    std::ifstream sectionIn(sectionPath);
+
+    *outFile << std::endl;
+    *outFile << sectionIn.rdbuf();
+    *outFile << std::endl;
+
+    if(!sectionB){
+        throw std::runtime_error("Unable to write the patch section '" + sectionPath + "'");
+    }
+    return ClosePatchOutput(*outFile, destination);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "scan_record.hpp"
+#include "compressed_output.hpp"
+
+// Building blocks of the external memory reconcile: sorted runs on disk are merged
+// and reconciled as streams so no stage holds a whole tree in memory
+
+// Removes the files it holds on destruction, whatever way the work using them ends
+struct TempFiles{
+    std::vector<std::string> paths;
+
+    // Concurrent scans create their runs in the same set
+    std::mutex pathsLock;
+
+    TempFiles() = default;
+    TempFiles(const TempFiles&) = delete;
+    TempFiles& operator=(const TempFiles&) = delete;
+    ~TempFiles();
+
+    // A new unique path in the directory, removed along with the others. Safe to call from several threads
+    std::string Create(const std::string& tempDir, const std::string& pattern);
+};
+
+// Merges groups of runs until at most fanIn are left, returns the remaining runs
+std::vector<std::string> ReduceRuns(std::vector<std::string> runs, size_t fanIn, TempFiles& temporaries,
+    const std::string& tempDir, unsigned long long& merges);
+
+// Opens a set of runs as a single sorted source
+std::unique_ptr<RecordSource> OpenRuns(const std::vector<std::string>& runs);
+
+// Reconciles two sorted sources in one merge pass, streaming both patch sections to the destination,
+// compressed at compressLevel unless it is 0. Throws if the patch couldn't be written
+PatchSize WriteStreamedResult(RecordSource& a, RecordSource& b, const std::string& dirA, const std::string& dirB,
+    const std::string& destination, bool ignoreUnchanged, const std::string& tempDir, int compressLevel = 0);
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define FAST_CHECKSUM_X86 1
+#include <immintrin.h>
+#endif
+
+#include "fast_checksum.hpp"
+
+namespace{
+    typedef uint32_t (*crc_kernel)(uint32_t, const unsigned char*, size_t);
+    typedef void (*adler_kernel)(uint32_t&, uint32_t&, const unsigned char*, size_t);
+
+    // Largest n such that 255n(n+1)/2 + (n+1)(BASE-1) fits in 32 bits, the sums are reduced at least that often
+    const uint32_t adlerBase = 65521;
+    const size_t adlerMaximumRun = 5552;
+
+    // Slicing-by-8 tables of the reflected polynomial 0xEDB88320
+    struct CrcTables{
+        uint32_t values[8][256];
+
+        CrcTables(){
+            for(uint32_t byte = 0; byte < 256; byte++){
+                uint32_t crc = byte;
+                for(int bit = 0; bit < 8; bit++){
+                    crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+                }
+                this->values[0][byte] = crc;
+            }
+
+            for(uint32_t byte = 0; byte < 256; byte++){
+                for(int slice = 1; slice < 8; slice++){
+                    uint32_t previous = this->values[slice - 1][byte];
+                    this->values[slice][byte] = (previous >> 8) ^ this->values[0][previous & 0xFF];
+                }
+            }
+        }
+    };
+
+    const CrcTables crcTables;
+
+    uint32_t crcTable(uint32_t crc, const unsigned char* data, size_t length){
+        const auto& table = crcTables.values;
+
+        while(length >= 8){
+            uint32_t low, high;
+            std::memcpy(&low, data, 4);
+            std::memcpy(&high, data + 4, 4);
+
+            // The words are read in memory order, which the tables assume to be little endian
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            low = __builtin_bswap32(low);
+            high = __builtin_bswap32(high);
+#endif
+            low ^= crc;
+            crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24]
+                ^ table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+
+            data += 8;
+            length -= 8;
+        }
+
+        while(length-- > 0){
+            crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xFF];
+        }
+
+        return crc;
+    }
+
+    void adlerScalar(uint32_t& s1, uint32_t& s2, const unsigned char* data, size_t length){
+        while(length > 0){
+            size_t run = std::min(length, adlerMaximumRun);
+            length -= run;
+
+            while(run-- > 0){
+                s1 += *data++;
+                s2 += s1;
+            }
+
+            s1 %= adlerBase;
+            s2 %= adlerBase;
+        }
+    }
+
+#ifdef FAST_CHECKSUM_X86
+    // Folds 64 bytes at a time into four 128-bit lanes, then folds the lanes and reduces them with Barrett's method.
+    // Constants and method from Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+    // Takes a multiple of 16 bytes, at least 64
+    __attribute__((target("pclmul,sse4.1")))
+    uint32_t crcFolded(uint32_t crc, const unsigned char* data, size_t length){
+        alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+        alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+        alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+        alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+        x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+        x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+        x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+        x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+        x0 = _mm_load_si128((const __m128i*)k1k2);
+
+        data += 64;
+        length -= 64;
+
+        // Four lanes folded in parallel
+        while(length >= 64){
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(data + 0x00)));
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(data + 0x10)));
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(data + 0x20)));
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(data + 0x30)));
+
+            data += 64;
+            length -= 64;
+        }
+
+        // Four lanes folded into one
+        x0 = _mm_load_si128((const __m128i*)k3k4);
+        for(__m128i next : {x2, x3, x4}){
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+        }
+
+        // Remaining 16 byte blocks
+        while(length >= 16){
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)data)), x5);
+
+            data += 16;
+            length -= 16;
+        }
+
+        // 128 bits to 64 bits
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+        x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction to 32 bits
+        x0 = _mm_load_si128((const __m128i*)poly);
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return _mm_extract_epi32(x1, 1);
+    }
+
+    uint32_t crcPclmul(uint32_t crc, const unsigned char* data, size_t length){
+        if(length >= 64){
+            size_t folded = length & ~(size_t)15;
+            crc = crcFolded(crc, data, folded);
+            data += folded;
+            length -= folded;
+        }
+
+        return crcTable(crc, data, length);
+    }
+
+    // Sums 32 bytes per step: s1 with byte sums, s2 with byte sums weighted 32..1 by multiply-adds,
+    // plus 32 times the s1 of every previous step
+    __attribute__((target("ssse3")))
+    void adlerSsse3(uint32_t& s1, uint32_t& s2, const unsigned char* data, size_t length){
+        const size_t blockSize = 32;
+        size_t blocks = length / blockSize;
+        length -= blocks * blockSize;
+
+        const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+        const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(1);
+
+        while(blocks > 0){
+            size_t steps = std::min(blocks, adlerMaximumRun / blockSize);
+            blocks -= steps;
+
+            __m128i previous = _mm_set_epi32(0, 0, 0, s1 * steps);
+            __m128i sumS2 = _mm_set_epi32(0, 0, 0, s2);
+            __m128i sumS1 = _mm_setzero_si128();
+
+            for(size_t step = 0; step < steps; step++){
+                const __m128i bytes1 = _mm_loadu_si128((const __m128i*)data);
+                const __m128i bytes2 = _mm_loadu_si128((const __m128i*)(data + 16));
+
+                previous = _mm_add_epi32(previous, sumS1);
+
+                sumS1 = _mm_add_epi32(sumS1, _mm_sad_epu8(bytes1, zero));
+                sumS2 = _mm_add_epi32(sumS2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+                sumS1 = _mm_add_epi32(sumS1, _mm_sad_epu8(bytes2, zero));
+                sumS2 = _mm_add_epi32(sumS2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+
+                data += blockSize;
+            }
+
+            sumS2 = _mm_add_epi32(sumS2, _mm_slli_epi32(previous, 5));
+
+            // Horizontal sums of the four lanes
+            sumS1 = _mm_add_epi32(sumS1, _mm_shuffle_epi32(sumS1, _MM_SHUFFLE(2, 3, 0, 1)));
+            sumS1 = _mm_add_epi32(sumS1, _mm_shuffle_epi32(sumS1, _MM_SHUFFLE(1, 0, 3, 2)));
+            s1 += _mm_cvtsi128_si32(sumS1);
+            sumS2 = _mm_add_epi32(sumS2, _mm_shuffle_epi32(sumS2, _MM_SHUFFLE(2, 3, 0, 1)));
+            sumS2 = _mm_add_epi32(sumS2, _mm_shuffle_epi32(sumS2, _MM_SHUFFLE(1, 0, 3, 2)));
+            s2 = _mm_cvtsi128_si32(sumS2);
+
+            s1 %= adlerBase;
+            s2 %= adlerBase;
+        }
+
+        adlerScalar(s1, s2, data, length);
+    }
+#endif
+
+    // Kernels are picked once, from what the CPU running the program supports
+    struct Kernels{
+        crc_kernel crc = crcTable;
+        adler_kernel adler = adlerScalar;
+        const char* crcName = "table";
+        const char* adlerName = "scalar";
+
+        Kernels(){
+#ifdef FAST_CHECKSUM_X86
+            __builtin_cpu_init();
+            if(__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")){
+                this->crc = crcPclmul;
+                this->crcName = "pclmul";
+            }
+            if(__builtin_cpu_supports("ssse3")){
+                this->adler = adlerSsse3;
+                this->adlerName = "ssse3";
+            }
+#endif
+        }
+    };
+
+    const Kernels kernels;
+}
+
+FastCRC32::FastCRC32() : state(0xFFFFFFFF) {}
+
+void FastCRC32::Update(const unsigned char* input, size_t length){
+    this->state = kernels.crc(this->state, input, length);
+}
+
+// Same layout as CryptoPP::CRC32: the final CRC in little endian byte order, then restart
+void FastCRC32::TruncatedFinal(unsigned char* digest, size_t digestSize){
+    uint32_t crc = this->state ^ 0xFFFFFFFF;
+    for(size_t i = 0; i < std::min(digestSize, (size_t)4); i++){
+        digest[i] = (unsigned char)(crc >> (8 * i));
+    }
+
+    this->state = 0xFFFFFFFF;
+}
+
+const char* FastCRC32::Implementation(){
+    return kernels.crcName;
+}
+
+FastAdler32::FastAdler32() : s1(1), s2(0) {}
+
+void FastAdler32::Update(const unsigned char* input, size_t length){
+    kernels.adler(this->s1, this->s2, input, length);
+}
+
+// Same layout as CryptoPP::Adler32: s2 then s1, both big endian, then restart
+void FastAdler32::TruncatedFinal(unsigned char* digest, size_t digestSize){
+    const unsigned char bytes[4] = {
+        (unsigned char)(this->s2 >> 8), (unsigned char)this->s2,
+        (unsigned char)(this->s1 >> 8), (unsigned char)this->s1
+    };
+    std::memcpy(digest, bytes, std::min(digestSize, sizeof(bytes)));
+
+    this->s1 = 1;
+    this->s2 = 0;
+}
+
+const char* FastAdler32::Implementation(){
+    return kernels.adlerName;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <cryptopp/cryptlib.h>
+
+// CRC32 (the IEEE polynomial, as CryptoPP::CRC32 and zlib compute it) folded with carry-less multiplies
+// when the CPU has PCLMULQDQ, with a slicing-by-8 table fallback. Digests match CryptoPP::CRC32
+class FastCRC32 : public CryptoPP::HashTransformation{
+private:
+    // Running CRC before the final inversion
+    uint32_t state;
+
+public:
+    FastCRC32();
+
+    void Update(const unsigned char* input, size_t length) override;
+    unsigned int DigestSize() const override { return 4; }
+    void TruncatedFinal(unsigned char* digest, size_t digestSize) override;
+    CryptoPP::Clonable* Clone() const override { return new FastCRC32(*this); }
+    std::string AlgorithmName() const override { return "CRC32"; }
+
+    // Kernel picked for this CPU
+    static const char* Implementation();
+};
+
+// Adler32 summed 32 bytes at a time with SSSE3 when the CPU has it, with a scalar fallback.
+// Digests match CryptoPP::Adler32
+class FastAdler32 : public CryptoPP::HashTransformation{
+private:
+    uint32_t s1;
+    uint32_t s2;
+
+public:
+    FastAdler32();
+
+    void Update(const unsigned char* input, size_t length) override;
+    unsigned int DigestSize() const override { return 4; }
+    void TruncatedFinal(unsigned char* digest, size_t digestSize) override;
+    CryptoPP::Clonable* Clone() const override { return new FastAdler32(*this); }
+    std::string AlgorithmName() const override { return "Adler32"; }
+
+    // Kernel picked for this CPU
+    static const char* Implementation();
+};
@@ -0,0 +1,127 @@
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "file_reader.hpp"
+
+FileReader::FileReader(ReadPolicy policy, long directThreshold, const std::atomic<bool>* cancelled)
+: policy(policy), directThreshold(directThreshold), cancelled(cancelled) {}
+
+unsigned char* FileReader::threadBuffer(){
+    static thread_local std::unique_ptr<unsigned char, decltype(&free)> buffer(nullptr, &free);
+
+    if(!buffer){
+        void* memory = nullptr;
+        if(posix_memalign(&memory, alignment, chunkSize) != 0){
+            throw std::bad_alloc();
+        }
+
+        buffer.reset(static_cast<unsigned char*>(memory));
+    }
+
+    return buffer.get();
+}
+
+unsigned long long FileReader::Read(const std::string& filepath, const chunk_consumer& consumer) const{
+    unsigned char* buffer = threadBuffer();
+    int fd = -1;
+
+#ifdef O_DIRECT
+    if(this->policy == ReadPolicy::DIRECT){
+        struct stat info;
+        if(stat(filepath.c_str(), &info) == 0 && info.st_size >= this->directThreshold){
+            // Not every filesystem supports direct I/O, fall through to a regular open then
+            fd = open(filepath.c_str(), O_RDONLY | O_DIRECT);
+        }
+    }
+#endif
+
+    bool direct = fd >= 0;
+    if(!direct){
+        fd = open(filepath.c_str(), O_RDONLY);
+    }
+
+    if(fd < 0){
+        throw std::runtime_error("Unable to open '" + filepath + "'");
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    if(!direct && this->policy != ReadPolicy::DEFAULT){
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+
+    unsigned long long offset = 0;
+    while(!this->cancelled || !*this->cancelled){
+        ssize_t count = read(fd, buffer, chunkSize);
+        if(count < 0){
+            close(fd);
+            throw std::runtime_error("Unable to read '" + filepath + "'");
+        }
+        if(count == 0){
+            break;
+        }
+
+        consumer(buffer, count);
+
+#ifdef POSIX_FADV_DONTNEED
+        // Drop what was just hashed, the file won't be read again
+        if(!direct && (this->policy == ReadPolicy::DROPBEHIND || this->policy == ReadPolicy::DIRECT)){
+            posix_fadvise(fd, offset, count, POSIX_FADV_DONTNEED);
+        }
+#endif
+
+        offset += count;
+    }
+
+    close(fd);
+    return offset;
+}
+
+unsigned long long FileReader::ResidentBytes(const std::string& filepath){
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if(fd < 0){
+        return 0;
+    }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0){
+        close(fd);
+        return 0;
+    }
+
+    unsigned long long resident = 0;
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(mapping != MAP_FAILED){
+        long pageSize = sysconf(_SC_PAGESIZE);
+        size_t pages = (info.st_size + pageSize - 1) / pageSize;
+        std::vector<unsigned char> residency(pages);
+
+        if(mincore(mapping, info.st_size, residency.data()) == 0){
+            for(unsigned char page : residency){
+                resident += (page & 1) ? pageSize : 0;
+            }
+        }
+
+        munmap(mapping, info.st_size);
+    }
+
+    return resident;
+}
+
+const char* FileReader::PolicyName(ReadPolicy policy){
+    switch(policy){
+        case ReadPolicy::SEQUENTIAL: return "sequential";
+        case ReadPolicy::DROPBEHIND: return "dropbehind";
+        case ReadPolicy::DIRECT: return "direct";
+        default: return "default";
+    }
+}
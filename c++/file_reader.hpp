@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include "worker_options.hpp"
+
+typedef std::function<void(const unsigned char*, size_t)> chunk_consumer;
+
+// Reads whole files in chunks while applying a page cache policy
+class FileReader{
+private:
+    // Size of a single read, a multiple of the direct I/O alignment
+    static const size_t chunkSize = 1024 * 1024;
+    static const size_t alignment = 4096;
+
+    const ReadPolicy policy;
+    const long directThreshold;
+
+    // Stops reads early when set, may be null
+    const std::atomic<bool>* cancelled;
+
+    // Aligned read buffer of the calling thread, reused across files
+    static unsigned char* threadBuffer();
+
+public:
+    // ctor w/ the policy, the size from which DIRECT bypasses the page cache and an optional cancellation flag
+    FileReader(ReadPolicy policy, long directThreshold, const std::atomic<bool>* cancelled = nullptr);
+
+    // Feeds every chunk of the file to the consumer, returns the number of bytes read.
+    // A cancelled read stops at a chunk boundary
+    unsigned long long Read(const std::string& filepath, const chunk_consumer& consumer) const;
+
+    // Bytes of the file currently held in the page cache
+    static unsigned long long ResidentBytes(const std::string& filepath);
+
+    // Name of a policy as given on the command line
+    static const char* PolicyName(ReadPolicy policy);
+};
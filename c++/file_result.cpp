@@ -1,3 +1,4 @@
+#include <cmath>
 #include <limits>
 #include <iomanip>
 #include <sstream>
@@ -17,9 +18,14 @@ FileResult::FileResult(std::string path, std::string hash, long filesize, std::t
 
 // Equality operator
 bool FileResult::operator==(const FileResult& rhs){
+    return this->metadataMatches(rhs)
+        && this->hash == rhs.hash;
+}
+
+// Equality of everything but the digest, whichever side is newer
+bool FileResult::metadataMatches(const FileResult& rhs){
     return this->size == rhs.size
-        && std::difftime(this->timeModified, rhs.timeModified) < std::numeric_limits<double>::epsilon()
-        && this->hash == rhs.hash
+        && std::fabs(std::difftime(this->timeModified, rhs.timeModified)) < std::numeric_limits<double>::epsilon()
         && this->filepath == rhs.filepath;
 }
 
@@ -10,6 +10,9 @@ struct FileResult{
     long size;
     std::time_t timeModified;
 
+    // For a MOVE, the path the same content already has on the other side
+    std::string movedFrom;
+
     // ctor
     FileResult();
 
@@ -19,6 +22,9 @@ struct FileResult{
     // Equality operator
     bool operator==(const FileResult& rhs);
 
+    // Equality of everything but the digest
+    bool metadataMatches(const FileResult& rhs);
+
     // String representation
     std::string toString();
 
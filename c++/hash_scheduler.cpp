@@ -0,0 +1,170 @@
+#include <algorithm>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+#include "hash_scheduler.hpp"
+
+HashScheduler::HashScheduler(ThreadPool& pool, hash_function hasher, IoOrder order, long batchWindow, WorkerStats& stats,
+    ConcurrencyKnob* knob)
+: pool(pool), hasher(hasher), order(order), batchWindow(batchWindow), stats(stats), knob(knob), inflight(0) {}
+
+HashScheduler::~HashScheduler(){
+    std::unique_lock<std::mutex> guard(this->inflightLock);
+    this->inflightDone.wait(guard, [this]{ return this->inflight == 0; });
+
+    if(this->knob){
+        this->knob->Retire();
+    }
+}
+
+unsigned long long HashScheduler::locate(const std::string& filepath){
+    if(this->order == IoOrder::WALK){
+        return 0;
+    }
+
+#ifdef __linux__
+    if(this->order == IoOrder::EXTENT){
+        int fd = open(filepath.c_str(), O_RDONLY);
+        if(fd >= 0){
+            // Room for the header and the first extent only
+            alignas(struct fiemap) char buffer[sizeof(struct fiemap) + sizeof(struct fiemap_extent)] = {};
+            auto request = reinterpret_cast<struct fiemap*>(buffer);
+            request->fm_length = FIEMAP_MAX_OFFSET;
+            request->fm_extent_count = 1;
+
+            bool mapped = ioctl(fd, FS_IOC_FIEMAP, request) == 0 && request->fm_mapped_extents > 0;
+            close(fd);
+
+            if(mapped){
+                return request->fm_extents[0].fe_physical;
+            }
+        }
+    }
+#endif
+
+    struct stat info;
+    if(stat(filepath.c_str(), &info) != 0){
+        return 0;
+    }
+
+    return info.st_ino;
+}
+
+void HashScheduler::Add(std::string filepath, FileResultPtr result){
+    unsigned long long location = this->locate(filepath);
+    this->pending.push_back(HashJob{std::move(filepath), result, location});
+
+    if(this->batchWindow > 0 && this->pending.size() >= this->batchWindow){
+        this->dispatch();
+    }
+}
+
+void HashScheduler::dispatch(){
+    if(this->pending.empty()){
+        return;
+    }
+
+    // Large files go first, biggest first, so they don't end up as the tail of the batch
+    auto large = std::partition(this->pending.begin(), this->pending.end(),
+        [](const HashJob& job){ return job.result->size >= largeFileSize; });
+    std::sort(this->pending.begin(), large,
+        [](const HashJob& a, const HashJob& b){ return a.result->size > b.result->size; });
+
+    // The rest follows the device layout (stable, so WALK keeps discovery order)
+    std::stable_sort(large, this->pending.end(),
+        [](const HashJob& a, const HashJob& b){ return a.location < b.location; });
+
+    std::vector<HashJob> group;
+    long groupBytes = 0;
+    for(auto& job : this->pending){
+        if(job.result->size > smallFileSize){
+            this->post({job});
+            continue;
+        }
+
+        group.push_back(job);
+        groupBytes += job.result->size;
+        if(group.size() >= groupMaxFiles || groupBytes >= groupMaxBytes){
+            this->post(std::move(group));
+            group.clear();
+            groupBytes = 0;
+        }
+    }
+
+    if(!group.empty()){
+        this->post(std::move(group));
+    }
+
+    this->stats.HashBatches++;
+    this->pending.clear();
+}
+
+void HashScheduler::post(std::vector<HashJob> group){
+    this->stats.HashRequests++;
+
+    std::lock_guard<std::mutex> guard(this->inflightLock);
+    if(this->knob && this->inflight >= this->knob->Limit()){
+        this->ready.push_back(std::move(group));
+        this->knob->SetBacklogged(true);
+        return;
+    }
+
+    this->submit(std::move(group));
+}
+
+void HashScheduler::submit(std::vector<HashJob> group){
+    this->inflight++;
+
+    this->pool.Post([this, group]{
+        std::exception_ptr error;
+        unsigned long long bytes = 0;
+        try{
+            for(auto& job : group){
+                job.result->hash = this->hasher(job.filepath);
+                bytes += job.result->size;
+            }
+        }
+        catch(...){
+            error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> guard(this->inflightLock);
+        if(error && !this->failure){
+            this->failure = error;
+        }
+
+        // Completed work frees slots for the queued requests, as many as the limit now allows
+        this->inflight--;
+        if(this->knob){
+            this->knob->Record(group.size(), bytes);
+            while(!this->ready.empty() && this->inflight < this->knob->Limit()){
+                this->submit(std::move(this->ready.front()));
+                this->ready.pop_front();
+            }
+            this->knob->SetBacklogged(!this->ready.empty());
+        }
+
+        if(this->inflight == 0){
+            this->inflightDone.notify_all();
+        }
+    });
+}
+
+void HashScheduler::Finish(){
+    this->dispatch();
+
+    std::unique_lock<std::mutex> guard(this->inflightLock);
+    this->inflightDone.wait(guard, [this]{ return this->inflight == 0; });
+
+    if(this->failure){
+        std::rethrow_exception(this->failure);
+    }
+}
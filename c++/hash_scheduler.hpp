@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "concurrency_controller.hpp"
+#include "file_result.hpp"
+#include "thread_pool.hpp"
+#include "worker_options.hpp"
+#include "worker_stats.hpp"
+
+// A file waiting for its digest
+struct HashJob{
+    std::string filepath;
+    FileResultPtr result;
+
+    // Sort key approximating the position of the file on the device
+    unsigned long long location;
+};
+
+typedef std::function<std::string(const std::string&)> hash_function;
+
+// Collects discovered files and dispatches their hashing in device order
+class HashScheduler{
+private:
+    // Files at most this large are grouped into a single request
+    static const long smallFileSize = 64 * 1024;
+
+    // Limits of a grouped request
+    static const size_t groupMaxFiles = 64;
+    static const long groupMaxBytes = 1024 * 1024;
+
+    // Files at least this large are dispatched ahead of the rest of their batch
+    static const long largeFileSize = 64 * 1024 * 1024;
+
+    ThreadPool& pool;
+    const hash_function hasher;
+    const IoOrder order;
+    const size_t batchWindow;
+    WorkerStats& stats;
+
+    // Limits the requests running at once when set
+    ConcurrencyKnob* const knob;
+
+    std::vector<HashJob> pending;
+
+    // Requests waiting for the knob to allow them
+    std::deque<std::vector<HashJob>> ready;
+
+    // In-flight request tracking
+    std::mutex inflightLock;
+    std::condition_variable inflightDone;
+    size_t inflight;
+    std::exception_ptr failure;
+
+    // Look up the sort key of a file for the configured policy
+    unsigned long long locate(const std::string& filepath);
+
+    // Order the pending jobs and post them to the pool
+    void dispatch();
+
+    // Post a group of jobs as one pool task, or queue it while the knob's limit is reached
+    void post(std::vector<HashJob> group);
+
+    // Hand a request to the pool, called with inflightLock held
+    void submit(std::vector<HashJob> group);
+
+public:
+    // ctor w/ the pool running the requests, the function computing a digest and optionally a knob limiting
+    // the requests running at once
+    HashScheduler(ThreadPool& pool, hash_function hasher, IoOrder order, long batchWindow, WorkerStats& stats,
+        ConcurrencyKnob* knob = nullptr);
+
+    // Waits for the requests still running so none outlives the scheduler
+    ~HashScheduler();
+
+    // Queue a file, its digest will be stored into result->hash
+    void Add(std::string filepath, FileResultPtr result);
+
+    // Dispatch what is left and wait for every request, rethrows the first hashing error
+    void Finish();
+};
@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "merkle_tree.hpp"
+#include "checksum.hpp"
+#include "scan_record.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace{
+    // Name of the cache format, in the header record
+    const char* cacheFormat = "reconcile-scan-2";
+
+    std::string toHex(CryptoPP::HashTransformation& checksum){
+        static const char hexDigits[] = "0123456789ABCDEF";
+        std::vector<unsigned char> raw(checksum.DigestSize());
+        checksum.Final(raw.data());
+
+        std::string digest(2 * raw.size(), '0');
+        for(size_t i = 0; i < raw.size(); i++){
+            digest[2 * i] = hexDigits[raw[i] >> 4];
+            digest[2 * i + 1] = hexDigits[raw[i] & 0x0F];
+        }
+        return digest;
+    }
+
+    // Feeds a child entry to the digest of its directory: kind, name, then size, time and digest for files
+    void addEntry(CryptoPP::HashTransformation& checksum, char kind, const std::string& name,
+        int64_t size, int64_t timeModified, const std::string& digest){
+        checksum.Update((const unsigned char*)&kind, 1);
+        checksum.Update((const unsigned char*)name.c_str(), name.length() + 1);
+        checksum.Update((const unsigned char*)&size, sizeof(size));
+        checksum.Update((const unsigned char*)&timeModified, sizeof(timeModified));
+        checksum.Update((const unsigned char*)digest.c_str(), digest.length() + 1);
+    }
+
+    // A directory whose entries are still being fed
+    struct OpenDirectory{
+        std::string path;
+        checksum_ptr checksum;
+        size_t files;
+        bool complete;
+    };
+}
+
+// Builds the digest of every directory holding a file from the files of a root, sorted by path
+directory_digests BuildDirectoryDigests(const std::vector<FileResultPtr>& sorted){
+    // Directory digests are MD5 whatever the file digests are, a weak file checksum doesn't weaken the tree too
+    checksum_ptr prototype = CreateChecksum("md5");
+    directory_digests directories;
+
+    // The directories from the root down to the parent of the current file. Files come in path order,
+    // so a directory is finished as soon as a file outside of it shows up
+    std::vector<OpenDirectory> open;
+    auto openDirectory = [&](const std::string& path){
+        open.push_back(OpenDirectory{path, checksum_ptr((CryptoPP::HashTransformation*)prototype->Clone()), 0, true});
+    };
+    auto closeDirectory = [&]{
+        OpenDirectory finished = std::move(open.back());
+        open.pop_back();
+
+        DirectoryDigest& entry = directories[finished.path];
+        entry.files = finished.files;
+        entry.digest = toHex(*finished.checksum);
+        if(!finished.complete){
+            entry.digest.clear();
+        }
+
+        if(!open.empty()){
+            OpenDirectory& parent = open.back();
+            std::string name = finished.path.substr(parent.path.empty() ? 0 : parent.path.length() + 1);
+            addEntry(*parent.checksum, 'd', name, 0, 0, entry.digest);
+            parent.files += finished.files;
+            parent.complete = parent.complete && finished.complete;
+        }
+    };
+
+    openDirectory("");
+    for(auto& file : sorted){
+        size_t separator = file->filepath.rfind('/');
+        std::string parent = separator == std::string::npos ? std::string() : file->filepath.substr(0, separator);
+
+        // Leave the directories that don't contain this file
+        while(open.size() > 1){
+            const std::string& current = open.back().path;
+            if(parent.compare(0, current.length(), current) == 0
+                && (parent.length() == current.length() || parent[current.length()] == '/')){
+                break;
+            }
+            closeDirectory();
+        }
+
+        // Enter the directories between the deepest open one and the parent of the file
+        while(open.back().path.length() < parent.length()){
+            size_t start = open.back().path.empty() ? 0 : open.back().path.length() + 1;
+            size_t end = parent.find('/', start);
+            openDirectory(parent.substr(0, end == std::string::npos ? parent.length() : end));
+        }
+
+        OpenDirectory& directory = open.back();
+        addEntry(*directory.checksum, 'f', file->filepath.substr(separator == std::string::npos ? 0 : separator + 1),
+            file->size, file->timeModified, file->hash);
+        directory.files++;
+        directory.complete = directory.complete && !file->hash.empty();
+    }
+
+    while(!open.empty()){
+        closeDirectory();
+    }
+
+    return directories;
+}
+
+std::string ScanCache::PathFor(const std::string& cacheDirectory, const std::string& root){
+    // One file per root, named after the digest of its absolute path
+    checksum_ptr checksum = CreateChecksum("md5");
+    std::string absolute = fs::absolute(root).string();
+    checksum->Update((const unsigned char*)absolute.data(), absolute.length());
+
+    return (fs::path(cacheDirectory) / (toHex(*checksum) + ".scan")).string();
+}
+
+bool ScanCache::Load(const std::string& filepath, const std::string& algorithm){
+    this->files.clear();
+    this->scanned = 0;
+    if(!fs::exists(filepath)){
+        return false;
+    }
+
+    // Every entry is a scan record: a header (format, algorithm, file count, scan start), then the files
+    try{
+        RecordReader reader(filepath);
+        FileResult header;
+        if(!reader.Next(header) || header.filepath != cacheFormat || header.hash != algorithm){
+            return false;
+        }
+
+        FileResult record;
+        for(long file = 0; file < header.size && reader.Next(record); file++){
+            this->files[record.filepath] = record;
+        }
+        this->scanned = header.timeModified;
+    }
+    catch(const std::exception&){
+        this->files.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool ScanCache::Save(const std::string& filepath, const std::string& algorithm,
+    const std::vector<FileResultPtr>& sorted, std::time_t scanned){
+    boost::system::error_code error;
+    fs::create_directories(fs::path(filepath).parent_path(), error);
+
+    // Written aside and renamed over the previous cache, a reader never sees half a cache
+    std::string partial = filepath + ".partial";
+    std::FILE* output = std::fopen(partial.c_str(), "wb");
+    if(!output){
+        return false;
+    }
+
+    // Files left without a digest (deferred hashing) are read again by the next run anyway
+    long digested = (long)std::count_if(sorted.begin(), sorted.end(), [](const FileResultPtr& file){ return !file->hash.empty(); });
+
+    bool written = WriteRecord(output, FileResult(cacheFormat, algorithm, digested, scanned));
+    for(size_t file = 0; file < sorted.size() && written; file++){
+        if(!sorted[file]->hash.empty()){
+            written = WriteRecord(output, *sorted[file]);
+        }
+    }
+
+    written = std::fclose(output) == 0 && written;
+    if(!written || std::rename(partial.c_str(), filepath.c_str()) != 0){
+        std::remove(partial.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+std::string ScanCache::Digest(const FileResult& file) const{
+    auto entry = this->files.find(file.filepath);
+    if(entry == this->files.end() || entry->second.size != file.size || entry->second.timeModified != file.timeModified
+        || entry->second.timeModified >= this->scanned){
+        return std::string();
+    }
+
+    return entry->second.hash;
+}
+
+size_t ScanCache::Size() const{
+    return this->files.size();
+}
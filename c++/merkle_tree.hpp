@@ -0,0 +1,53 @@
+#pragma once
+
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "file_result.hpp"
+
+// Digest of a directory over its children: name, size, modification time and digest of every file,
+// name and digest of every subdirectory. Two directories with the same digest hold the same files
+struct DirectoryDigest{
+    // Upper case hex MD5, empty when a file below has no digest (deferred hashing)
+    std::string digest;
+
+    // Files in the whole subtree
+    size_t files = 0;
+};
+
+// Directory digests of a root keyed by root-relative path, "" being the root itself
+typedef std::unordered_map<std::string, DirectoryDigest> directory_digests;
+
+// Builds the digest of every directory holding a file from the files of a root, sorted by path
+directory_digests BuildDirectoryDigests(const std::vector<FileResultPtr>& sorted);
+
+// A scan persisted between runs: every file with its digest and the time the scan started.
+// A file found again with the same size and modification time takes its digest from the cache instead of being read
+class ScanCache{
+private:
+    std::unordered_map<std::string, FileResult> files;
+
+    // When the cached scan started, a file modified since may have changed again within the same second
+    std::time_t scanned = 0;
+
+public:
+    // Cache file of a root inside a cache directory
+    static std::string PathFor(const std::string& cacheDirectory, const std::string& root);
+
+    // Loads the files of a cache written with the same algorithm, false when there is none or it can't be read
+    bool Load(const std::string& filepath, const std::string& algorithm);
+
+    // Writes the files of a root that have a digest, sorted by path, replacing the previous cache.
+    // scanned is when the walk that found them started
+    static bool Save(const std::string& filepath, const std::string& algorithm,
+        const std::vector<FileResultPtr>& sorted, std::time_t scanned);
+
+    // Cached digest of a file with the same path, size and modification time, empty if there is none
+    // or if it was modified after the cached scan started
+    std::string Digest(const FileResult& file) const;
+
+    // Number of files loaded
+    size_t Size() const;
+};
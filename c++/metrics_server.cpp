@@ -0,0 +1,132 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "metrics_server.hpp"
+
+namespace{
+    // Highest TCP port number
+    const unsigned long maxPort = 65535;
+}
+
+MetricsServer::MetricsServer(std::string endpoint, std::function<std::string()> render)
+: endpoint(endpoint), render(render), listener(-1), socketDevice(0), socketInode(0), stopping(false) {
+    this->unixSocket = endpoint.empty() || endpoint.find_first_not_of("0123456789") != std::string::npos;
+
+    bool bound = false;
+    if(this->unixSocket){
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if(endpoint.length() < sizeof(address.sun_path)){
+            std::strcpy(address.sun_path, endpoint.c_str());
+
+            // Only a socket left behind by a previous run is replaced, never a file that merely has the name
+            struct stat existing;
+            if(lstat(endpoint.c_str(), &existing) == 0){
+                if(!S_ISSOCK(existing.st_mode)){
+                    throw std::runtime_error("Unable to serve metrics on '" + endpoint + "': it exists and is not a socket");
+                }
+                unlink(endpoint.c_str());
+            }
+
+            this->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+            bound = this->listener >= 0 && bind(this->listener, (struct sockaddr*)&address, sizeof(address)) == 0;
+
+            // Remembered so the destructor only removes the socket it created
+            struct stat created;
+            if(bound && lstat(endpoint.c_str(), &created) == 0){
+                this->socketDevice = created.st_dev;
+                this->socketInode = created.st_ino;
+            }
+        }
+    }
+    else{
+        // Digits only, but possibly too many for a port, std::stoul would wrap or throw on them
+        unsigned long port = endpoint.length() <= 5 ? std::stoul(endpoint) : 0;
+        if(port < 1 || port > maxPort){
+            throw std::invalid_argument("Unable to serve metrics on port " + endpoint + ": ports go from 1 to " + std::to_string(maxPort));
+        }
+
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t)port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        this->listener = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        bound = this->listener >= 0
+            && setsockopt(this->listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == 0
+            && bind(this->listener, (struct sockaddr*)&address, sizeof(address)) == 0;
+    }
+
+    if(!bound || listen(this->listener, 8) != 0){
+        if(this->listener >= 0){
+            close(this->listener);
+        }
+        throw std::runtime_error("Unable to serve metrics on '" + endpoint + "': " + std::strerror(errno));
+    }
+
+    this->thread = std::thread(&MetricsServer::run, this);
+}
+
+MetricsServer::~MetricsServer(){
+    this->stopping = true;
+    this->thread.join();
+    close(this->listener);
+
+    // The path may have been replaced since, by anything other than the socket bound here
+    struct stat current;
+    if(this->unixSocket && lstat(this->endpoint.c_str(), &current) == 0 && S_ISSOCK(current.st_mode)
+        && current.st_dev == this->socketDevice && current.st_ino == this->socketInode){
+        unlink(this->endpoint.c_str());
+    }
+}
+
+void MetricsServer::run(){
+    struct pollfd waiting = {this->listener, POLLIN, 0};
+
+    while(!this->stopping){
+        // Wake up regularly to notice the end of the run
+        if(poll(&waiting, 1, 200) <= 0 || !(waiting.revents & POLLIN)){
+            continue;
+        }
+
+        int client = accept(this->listener, nullptr, nullptr);
+        if(client < 0){
+            continue;
+        }
+
+        // Any request gets the page, reading it only keeps clients from seeing a reset
+        struct pollfd request = {client, POLLIN, 0};
+        char buffer[4096];
+        if(poll(&request, 1, 1000) > 0){
+            ssize_t ignored = recv(client, buffer, sizeof(buffer), 0);
+            (void)ignored;
+        }
+
+        std::string body = this->render();
+        std::string response = "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: " + std::to_string(body.length()) + "\r\n"
+            "Connection: close\r\n\r\n" + body;
+
+        size_t sent = 0;
+        while(sent < response.length()){
+            ssize_t written = send(client, response.data() + sent, response.length() - sent, MSG_NOSIGNAL);
+            if(written <= 0){
+                break;
+            }
+            sent += written;
+        }
+
+        close(client);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <sys/types.h>
+
+// Serves a text page over HTTP, on localhost when the endpoint is a port number and on a Unix socket otherwise
+// (for instance: curl http://127.0.0.1:9100/metrics, curl --unix-socket /tmp/reconcile.sock http://localhost/metrics)
+class MetricsServer{
+private:
+    const std::string endpoint;
+    const std::function<std::string()> render;
+
+    int listener;
+    bool unixSocket;
+
+    // Identity of the Unix socket file created, the only one removed on exit
+    dev_t socketDevice;
+    ino_t socketInode;
+
+    std::atomic<bool> stopping;
+    std::thread thread;
+
+    // Accepts and answers connections until stopped
+    void run();
+
+public:
+    // ctor w/ the endpoint and the function producing the page, throws when the endpoint isn't a valid port,
+    // names something other than a socket, or can't be bound
+    MetricsServer(std::string endpoint, std::function<std::string()> render);
+
+    // Stops serving and removes the Unix socket if it is still the one created
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+};
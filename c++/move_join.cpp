@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+#include "move_join.hpp"
+
+namespace{
+    // Rough cost of one build table entry: node, bucket and key
+    const long buildEntryBytes = 64;
+
+    size_t contentHash(const FileResult& entry){
+        return std::hash<std::string>()(entry.hash) * 31 + std::hash<long>()(entry.size);
+    }
+}
+
+std::vector<move_match> JoinOnContent(const std::vector<FileResultPtr>& left, const std::vector<FileResultPtr>& right,
+    ThreadPool& pool, long memoryBudget){
+    if(left.empty() || right.empty()){
+        return {};
+    }
+
+    // Build on the smaller side
+    bool swapped = left.size() > right.size();
+    const std::vector<FileResultPtr>& build = swapped ? right : left;
+    const std::vector<FileResultPtr>& probe = swapped ? left : right;
+
+    size_t partitionCount = std::max<size_t>(pool.Size(),
+        (build.size() * buildEntryBytes + memoryBudget - 1) / std::max(memoryBudget, 1L));
+
+    // Partition both sides by content hash, only indices are stored
+    std::vector<std::vector<size_t>> buildPartitions(partitionCount), probePartitions(partitionCount);
+    for(size_t i = 0; i < build.size(); i++){
+        buildPartitions[contentHash(*build[i]) % partitionCount].push_back(i);
+    }
+    for(size_t i = 0; i < probe.size(); i++){
+        probePartitions[contentHash(*probe[i]) % partitionCount].push_back(i);
+    }
+
+    std::vector<std::vector<move_match>> partitionMatches(partitionCount);
+    std::mutex remainingLock;
+    std::condition_variable remainingDone;
+    size_t remaining = partitionCount;
+
+    for(size_t partition = 0; partition < partitionCount; partition++){
+        pool.Post([&, partition]{
+            auto& matches = partitionMatches[partition];
+            if(!buildPartitions[partition].empty() && !probePartitions[partition].empty()){
+                // Digest -> build indices still unmatched, sizes are compared when probing
+                std::unordered_multimap<std::string, size_t> table;
+                table.reserve(buildPartitions[partition].size());
+                for(size_t index : buildPartitions[partition]){
+                    table.emplace(build[index]->hash, index);
+                }
+
+                for(size_t index : probePartitions[partition]){
+                    auto candidates = table.equal_range(probe[index]->hash);
+                    for(auto candidate = candidates.first; candidate != candidates.second; ++candidate){
+                        if(build[candidate->second]->size == probe[index]->size){
+                            matches.push_back(swapped
+                                ? move_match(index, candidate->second)
+                                : move_match(candidate->second, index));
+                            table.erase(candidate);
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // Release the partition before the next one is built
+            std::vector<size_t>().swap(buildPartitions[partition]);
+            std::vector<size_t>().swap(probePartitions[partition]);
+
+            std::lock_guard<std::mutex> guard(remainingLock);
+            if(--remaining == 0){
+                remainingDone.notify_all();
+            }
+        });
+    }
+
+    std::unique_lock<std::mutex> guard(remainingLock);
+    remainingDone.wait(guard, [&]{ return remaining == 0; });
+
+    std::vector<move_match> matches;
+    for(auto& partition : partitionMatches){
+        matches.insert(matches.end(), partition.begin(), partition.end());
+    }
+
+    return matches;
+}
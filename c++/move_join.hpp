@@ -0,0 +1,16 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "file_result.hpp"
+#include "thread_pool.hpp"
+
+// Indices of a matched pair, into the left and the right entries
+typedef std::pair<size_t, size_t> move_match;
+
+// Hash-joins two lists of hashed entries on (size, digest), pairing each entry at most once.
+// Both sides are split into partitions small enough for a build table to fit the memory budget,
+// and the partitions are joined in parallel on the pool
+std::vector<move_match> JoinOnContent(const std::vector<FileResultPtr>& left, const std::vector<FileResultPtr>& right,
+    ThreadPool& pool, long memoryBudget);
@@ -0,0 +1,231 @@
+#include <fstream>
+
+#include "path_filter.hpp"
+
+PathFilter::Pattern PathFilter::compile(std::string glob){
+    Pattern pattern;
+    pattern.negated = !glob.empty() && glob[0] == '!';
+    if(pattern.negated){
+        glob.erase(0, 1);
+    }
+
+    pattern.directoryOnly = !glob.empty() && glob.back() == '/';
+    if(pattern.directoryOnly){
+        glob.pop_back();
+    }
+
+    pattern.anchored = glob.find('/') != std::string::npos;
+    if(!glob.empty() && glob[0] == '/'){
+        glob.erase(0, 1);
+    }
+
+    auto literal = [&](char c){
+        if(pattern.tokens.empty() || pattern.tokens.back().type != TokenType::LITERAL){
+            pattern.tokens.push_back(Token{TokenType::LITERAL, "", {}});
+        }
+        pattern.tokens.back().text += c;
+    };
+
+    for(size_t i = 0; i < glob.length(); i++){
+        char c = glob[i];
+        if(c == '\\' && i + 1 < glob.length()){
+            literal(glob[++i]);
+        }
+        else if(c == '?'){
+            pattern.tokens.push_back(Token{TokenType::ANY_CHAR, "", {}});
+        }
+        else if(c == '*' && i + 1 < glob.length() && glob[i + 1] == '*'){
+            i++;
+            if(i + 1 < glob.length() && glob[i + 1] == '/'){
+                i++;
+                pattern.tokens.push_back(Token{TokenType::GLOBSTAR_DIR, "", {}});
+            }
+            else{
+                pattern.tokens.push_back(Token{TokenType::GLOBSTAR, "", {}});
+            }
+        }
+        else if(c == '*'){
+            pattern.tokens.push_back(Token{TokenType::STAR, "", {}});
+        }
+        else if(c == '[' && glob.find(']', i + 2) != std::string::npos){
+            Token token{TokenType::CLASS, "", {}};
+            size_t close = glob.find(']', i + 2);
+            bool negate = glob[i + 1] == '!' || glob[i + 1] == '^';
+
+            for(size_t j = i + (negate ? 2 : 1); j < close; j++){
+                if(j + 2 < close && glob[j + 1] == '-'){
+                    for(int k = (unsigned char)glob[j]; k <= (unsigned char)glob[j + 2]; k++){
+                        token.characters.set(k);
+                    }
+                    j += 2;
+                }
+                else{
+                    token.characters.set((unsigned char)glob[j]);
+                }
+            }
+
+            if(negate){
+                token.characters.flip();
+            }
+            token.characters.reset('/');
+            pattern.tokens.push_back(token);
+            i = close;
+        }
+        else{
+            literal(c);
+        }
+    }
+
+    bool literalOnly = pattern.tokens.size() == 1 && pattern.tokens[0].type == TokenType::LITERAL;
+    bool suffix = pattern.tokens.size() == 2 && pattern.tokens[0].type == TokenType::STAR
+        && pattern.tokens[1].type == TokenType::LITERAL && pattern.tokens[1].text.find('/') == std::string::npos;
+    pattern.shape = pattern.tokens.empty() || literalOnly ? Shape::EXACT
+        : (suffix && !pattern.anchored ? Shape::SUFFIX : Shape::GENERAL);
+
+    return pattern;
+}
+
+bool PathFilter::matchTokens(const std::vector<Token>& tokens, size_t token, const std::string& text, size_t position){
+    for(; token < tokens.size(); token++){
+        const Token& current = tokens[token];
+        switch(current.type){
+            case TokenType::LITERAL:
+                if(text.compare(position, current.text.length(), current.text) != 0){
+                    return false;
+                }
+                position += current.text.length();
+                break;
+
+            case TokenType::ANY_CHAR:
+                if(position >= text.length() || text[position] == '/'){
+                    return false;
+                }
+                position++;
+                break;
+
+            case TokenType::CLASS:
+                if(position >= text.length() || !current.characters.test((unsigned char)text[position])){
+                    return false;
+                }
+                position++;
+                break;
+
+            case TokenType::STAR:
+                // Try every split within the current component, longest last
+                for(size_t end = position; ; end++){
+                    if(matchTokens(tokens, token + 1, text, end)){
+                        return true;
+                    }
+                    if(end >= text.length() || text[end] == '/'){
+                        return false;
+                    }
+                }
+
+            case TokenType::GLOBSTAR:
+                for(size_t end = position; end <= text.length(); end++){
+                    if(matchTokens(tokens, token + 1, text, end)){
+                        return true;
+                    }
+                }
+                return false;
+
+            case TokenType::GLOBSTAR_DIR:
+                // Nothing at all, or whole components each ending with '/'
+                if(matchTokens(tokens, token + 1, text, position)){
+                    return true;
+                }
+                for(size_t slash = text.find('/', position); slash != std::string::npos; slash = text.find('/', slash + 1)){
+                    if(matchTokens(tokens, token + 1, text, slash + 1)){
+                        return true;
+                    }
+                }
+                return false;
+        }
+    }
+
+    return position == text.length();
+}
+
+bool PathFilter::matches(const Pattern& pattern, const std::string& path, bool isDirectory){
+    if(pattern.directoryOnly && !isDirectory){
+        return false;
+    }
+
+    // Unanchored patterns only see the name
+    size_t nameStart = 0;
+    if(!pattern.anchored){
+        size_t slash = path.rfind('/');
+        nameStart = slash == std::string::npos ? 0 : slash + 1;
+    }
+    size_t nameLength = path.length() - nameStart;
+
+    switch(pattern.shape){
+        case Shape::EXACT:{
+            const std::string& text = pattern.tokens.empty() ? std::string() : pattern.tokens[0].text;
+            return nameLength == text.length() && path.compare(nameStart, nameLength, text) == 0;
+        }
+        case Shape::SUFFIX:{
+            const std::string& text = pattern.tokens[1].text;
+            return nameLength >= text.length() && path.compare(path.length() - text.length(), text.length(), text) == 0;
+        }
+        default:
+            return matchTokens(pattern.tokens, 0, nameStart == 0 ? path : path.substr(nameStart), 0);
+    }
+}
+
+void PathFilter::Exclude(const std::string& glob){
+    this->exclusions.push_back(compile(glob));
+}
+
+void PathFilter::Include(const std::string& glob){
+    this->inclusions.push_back(compile(glob));
+}
+
+bool PathFilter::LoadIgnoreFile(const std::string& filepath){
+    std::ifstream input(filepath);
+    if(!input){
+        return false;
+    }
+
+    std::string line;
+    while(std::getline(input, line)){
+        // Trailing carriage returns and spaces are not part of a pattern
+        while(!line.empty() && (line.back() == '\r' || line.back() == ' ')){
+            line.pop_back();
+        }
+
+        if(!line.empty() && line[0] != '#'){
+            this->Exclude(line);
+        }
+    }
+
+    return true;
+}
+
+bool PathFilter::Empty() const{
+    return this->exclusions.empty() && this->inclusions.empty();
+}
+
+bool PathFilter::Keeps(const std::string& path, bool isDirectory) const{
+    // The last matching exclusion or exception decides
+    for(auto pattern = this->exclusions.rbegin(); pattern != this->exclusions.rend(); ++pattern){
+        if(matches(*pattern, path, isDirectory)){
+            if(!pattern->negated){
+                return false;
+            }
+            break;
+        }
+    }
+
+    if(isDirectory || this->inclusions.empty()){
+        return true;
+    }
+
+    for(auto& pattern : this->inclusions){
+        if(matches(pattern, path, isDirectory)){
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <bitset>
+#include <string>
+#include <vector>
+
+// Include/exclude glob patterns compiled once and matched against root-relative paths during a walk.
+//
+// Patterns follow .gitignore conventions: '*' and '?' stay within a path component, '**' crosses them,
+// '[...]' is a character class. A pattern without a '/' matches the name at any depth, otherwise it is
+// anchored at the root. A trailing '/' only matches directories. Exclusions apply to directories (which
+// are then never descended into) and files, the last matching exclusion or '!' exception wins. When any
+// inclusion is given, files must also match one of them
+class PathFilter{
+private:
+    enum class TokenType{
+        LITERAL,        // Exact text
+        ANY_CHAR,       // '?'
+        STAR,           // '*', anything but '/'
+        GLOBSTAR,       // '**', anything
+        GLOBSTAR_DIR,   // '**/', nothing or anything ending with '/'
+        CLASS           // '[...]'
+    };
+
+    struct Token{
+        TokenType type;
+        std::string text;
+        std::bitset<256> characters;
+    };
+
+    // How a compiled pattern is checked, the simple shapes skip the general matcher
+    enum class Shape{
+        EXACT,      // No wildcards
+        SUFFIX,     // '*' followed by a literal, like '*.o'
+        GENERAL
+    };
+
+    struct Pattern{
+        std::vector<Token> tokens;
+        Shape shape;
+        bool anchored;
+        bool directoryOnly;
+        bool negated;
+    };
+
+    std::vector<Pattern> exclusions;
+    std::vector<Pattern> inclusions;
+
+    static Pattern compile(std::string glob);
+    static bool matchTokens(const std::vector<Token>& tokens, size_t token, const std::string& text, size_t position);
+    static bool matches(const Pattern& pattern, const std::string& path, bool isDirectory);
+
+public:
+    // Adds an exclusion, or an exception to the exclusions when it starts with '!'
+    void Exclude(const std::string& glob);
+
+    // Adds an inclusion files must match
+    void Include(const std::string& glob);
+
+    // Adds every exclusion of an ignore file (one pattern per line, '#' comments), false if it can't be read
+    bool LoadIgnoreFile(const std::string& filepath);
+
+    // Whether any pattern was given at all
+    bool Empty() const;
+
+    // Whether the walk keeps an entry, given its root-relative path
+    bool Keeps(const std::string& path, bool isDirectory) const;
+};
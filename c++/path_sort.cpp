@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <memory>
+
+#include "path_sort.hpp"
+
+namespace{
+    // Ranges this small are finished by insertion sort
+    const size_t insertionLimit = 32;
+
+    // Inputs this small are not worth a thread
+    const size_t parallelLimit = 1 << 16;
+
+    // A range of entries sharing their first depth bytes
+    struct SortRange{
+        size_t begin;
+        size_t end;
+        size_t depth;
+    };
+
+    // Byte at depth, shifted by one so that the end of the path (0) comes before every byte
+    inline unsigned int bucketOf(const PathSortEntry& entry, size_t depth){
+        return depth < entry.length ? (unsigned char)entry.path[depth] + 1 : 0;
+    }
+
+    // Compares the paths past their known common prefix
+    inline bool lessFrom(const PathSortEntry& a, const PathSortEntry& b, size_t depth){
+        size_t common = std::min(a.length, b.length) - depth;
+        int order = std::memcmp(a.path + depth, b.path + depth, common);
+        return order < 0 || (order == 0 && a.length < b.length);
+    }
+
+    void insertionSort(PathSortEntry* entries, size_t count, size_t depth){
+        for(size_t i = 1; i < count; i++){
+            PathSortEntry current = entries[i];
+            size_t j = i;
+            while(j > 0 && lessFrom(current, entries[j - 1], depth)){
+                entries[j] = entries[j - 1];
+                j--;
+            }
+            entries[j] = current;
+        }
+    }
+
+    // Distributes a range by its byte at depth, skipping the columns every entry agrees on.
+    // Returns the new depth and fills bounds with the 257 bucket boundaries, false if the range is finished
+    bool distribute(PathSortEntry* entries, PathSortEntry* scratch, size_t count, size_t& depth, size_t bounds[258]){
+        size_t counts[257];
+        while(true){
+            std::fill(counts, counts + 257, 0);
+            for(size_t i = 0; i < count; i++){
+                counts[bucketOf(entries[i], depth)]++;
+            }
+
+            // Every path ended here, the range holds equal paths
+            if(counts[0] == count){
+                return false;
+            }
+
+            // A column shared by the whole range costs one counting pass and no moves
+            if(std::find(counts + 1, counts + 257, count) == counts + 257){
+                break;
+            }
+            depth++;
+        }
+
+        bounds[0] = 0;
+        for(size_t bucket = 0; bucket < 257; bucket++){
+            bounds[bucket + 1] = bounds[bucket] + counts[bucket];
+        }
+
+        size_t next[257];
+        std::copy(bounds, bounds + 257, next);
+        for(size_t i = 0; i < count; i++){
+            scratch[next[bucketOf(entries[i], depth)]++] = entries[i];
+        }
+        std::copy(scratch, scratch + count, entries);
+
+        return true;
+    }
+
+    // Sorts a range on the calling thread
+    void sortRange(PathSortEntry* entries, PathSortEntry* scratch, size_t count, size_t depth){
+        if(count <= insertionLimit){
+            insertionSort(entries, count, depth);
+            return;
+        }
+
+        size_t bounds[258];
+        if(!distribute(entries, scratch, count, depth, bounds)){
+            return;
+        }
+
+        // Bucket 0 holds the paths ending at depth, already equal
+        for(size_t bucket = 1; bucket < 257; bucket++){
+            size_t size = bounds[bucket + 1] - bounds[bucket];
+            if(size > 1){
+                sortRange(entries + bounds[bucket], scratch + bounds[bucket], size, depth + 1);
+            }
+        }
+    }
+}
+
+void SortPaths(std::vector<PathSortEntry>& entries, ThreadPool* pool){
+    std::vector<PathSortEntry> scratch(entries.size());
+    if(!pool || pool->Size() < 2 || entries.size() < parallelLimit){
+        sortRange(entries.data(), scratch.data(), entries.size(), 0);
+        return;
+    }
+
+    // Ranges above the split size are distributed into more ranges, the others are sorted whole.
+    // Every thread takes the largest range left, so the big buckets start first
+    const size_t splitSize = std::max(insertionLimit, entries.size() / (8 * pool->Size()));
+    auto smaller = [](const SortRange& a, const SortRange& b){ return a.end - a.begin < b.end - b.begin; };
+
+    // Pool threads busy with other work may only pick their task up once the sort is over, so the queue
+    // outlives this call and a late task finds it empty without touching the entries
+    struct SharedRanges{
+        std::vector<SortRange> ranges;
+        std::mutex lock;
+        std::condition_variable changed;
+        unsigned int busy = 0;
+    };
+    auto shared = std::make_shared<SharedRanges>();
+    shared->ranges.push_back(SortRange{0, entries.size(), 0});
+
+    PathSortEntry* data = entries.data();
+    PathSortEntry* spare = scratch.data();
+    auto work = [shared, data, spare, splitSize, smaller](){
+        std::unique_lock<std::mutex> guard(shared->lock);
+        while(true){
+            shared->changed.wait(guard, [&]{ return !shared->ranges.empty() || shared->busy == 0; });
+            if(shared->ranges.empty()){
+                return;
+            }
+
+            std::pop_heap(shared->ranges.begin(), shared->ranges.end(), smaller);
+            SortRange range = shared->ranges.back();
+            shared->ranges.pop_back();
+            shared->busy++;
+            guard.unlock();
+
+            size_t count = range.end - range.begin;
+            std::vector<SortRange> split;
+            if(count <= splitSize){
+                sortRange(data + range.begin, spare + range.begin, count, range.depth);
+            }
+            else{
+                size_t bounds[258];
+                size_t depth = range.depth;
+                if(distribute(data + range.begin, spare + range.begin, count, depth, bounds)){
+                    for(size_t bucket = 1; bucket < 257; bucket++){
+                        if(bounds[bucket + 1] - bounds[bucket] > 1){
+                            split.push_back(SortRange{range.begin + bounds[bucket], range.begin + bounds[bucket + 1], depth + 1});
+                        }
+                    }
+                }
+            }
+
+            guard.lock();
+            for(auto& part : split){
+                shared->ranges.push_back(part);
+                std::push_heap(shared->ranges.begin(), shared->ranges.end(), smaller);
+            }
+            shared->busy--;
+            shared->changed.notify_all();
+        }
+    };
+
+    // The caller works too and only returns once no range is left or being sorted
+    for(unsigned int i = 1; i < pool->Size(); i++){
+        pool->Post(work);
+    }
+    work();
+}
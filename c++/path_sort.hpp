@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "alloc_tracking.hpp"
+#include "thread_pool.hpp"
+
+// A path to sort and the position of its owner
+struct PathSortEntry{
+    const char* path;
+    size_t length;
+    size_t index;
+};
+
+// Sorts the entries by path in std::string order with an MSD radix sort.
+// Common prefixes are skipped a whole byte column at a time instead of being compared again and again,
+// large inputs are shared with the threads of pool when one is given, small ones are always sorted by the caller
+void SortPaths(std::vector<PathSortEntry>& entries, ThreadPool* pool = nullptr);
+
+// Sorts any items by the path returned by key, moving every item exactly once
+template<typename T, typename Key>
+void SortByPath(std::vector<T>& items, Key key, ThreadPool* pool = nullptr){
+    AllocScope tracking(AllocStructure::SORT);
+    std::vector<PathSortEntry> entries;
+    entries.reserve(items.size());
+    for(size_t i = 0; i < items.size(); i++){
+        const std::string& path = key(items[i]);
+        entries.push_back(PathSortEntry{path.data(), path.length(), i});
+    }
+
+    SortPaths(entries, pool);
+
+    std::vector<T> sorted;
+    sorted.reserve(items.size());
+    for(auto& entry : entries){
+        sorted.push_back(std::move(items[entry.index]));
+    }
+    items.swap(sorted);
+}
@@ -0,0 +1,124 @@
+#include <sstream>
+
+#include "pipeline_metrics.hpp"
+
+namespace{
+    const char* phaseNames[] = {"idle", "scan", "reconcile", "moves", "output"};
+}
+
+size_t ShardedCounter::threadSlot(){
+    static std::atomic<size_t> nextSlot{0};
+    thread_local size_t slot = nextSlot++ % slotCount;
+    return slot;
+}
+
+unsigned long long ShardedCounter::Sum() const{
+    unsigned long long sum = 0;
+    for(auto& slot : this->slots){
+        sum += slot.value.load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+PipelineMetrics::PipelineMetrics(bool deferredHashing)
+: deferredHashing(deferredHashing), started(std::chrono::steady_clock::now()), sampled(started), phaseStarted(started) {}
+
+void PipelineMetrics::Enter(PipelinePhase phase){
+    std::lock_guard<std::mutex> guard(this->phaseLock);
+    if(phase == this->phase){
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    this->phaseSeconds[(int)this->phase] += std::chrono::duration<double>(now - this->phaseStarted).count();
+    this->phase = phase;
+    this->phaseStarted = now;
+}
+
+void PipelineMetrics::PrintTimings(std::ostream& out){
+    std::lock_guard<std::mutex> guard(this->phaseLock);
+    double current = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->phaseStarted).count();
+
+    // Idle time is the banner and argument handling, not worth reporting
+    for(int i = 1; i < 5; i++){
+        double seconds = this->phaseSeconds[i] + (i == (int)this->phase ? current : 0);
+        if(seconds > 0){
+            out << "Phase " << phaseNames[i] << ": " << seconds << " s" << std::endl;
+        }
+    }
+}
+
+std::string PipelineMetrics::Render(size_t hashQueueDepth){
+    auto now = std::chrono::steady_clock::now();
+    unsigned long long discovered = this->FilesDiscovered.Sum(), bytesDiscovered = this->BytesDiscovered.Sum();
+    unsigned long long hashed = this->FilesHashed.Sum(), bytesHashed = this->BytesHashed.Sum();
+    int walks = this->WalksActive;
+
+    double discoveredRate, hashedRate, bytesHashedRate;
+    {
+        std::lock_guard<std::mutex> guard(this->ratesLock);
+        double seconds = std::chrono::duration<double>(now - this->sampled).count();
+        if(seconds >= rateWindowSeconds){
+            this->discoveredRate = (discovered - this->sampledDiscovered) / seconds;
+            this->hashedRate = (hashed - this->sampledHashed) / seconds;
+            this->bytesHashedRate = (bytesHashed - this->sampledBytesHashed) / seconds;
+            this->sampled = now;
+            this->sampledDiscovered = discovered;
+            this->sampledHashed = hashed;
+            this->sampledBytesHashed = bytesHashed;
+        }
+
+        discoveredRate = this->discoveredRate;
+        hashedRate = this->hashedRate;
+        bytesHashedRate = this->bytesHashedRate;
+
+        // Until a first window has passed, the average since the start is all there is
+        if(this->sampled == this->started && seconds > 0){
+            discoveredRate = discovered / seconds;
+            hashedRate = hashed / seconds;
+            bytesHashedRate = bytesHashed / seconds;
+        }
+    }
+
+    std::ostringstream out;
+    auto metric = [&out](const char* name, const char* type, const char* help, double value){
+        out << "# HELP " << name << " " << help << "\n"
+            << "# TYPE " << name << " " << type << "\n"
+            << name << " " << value << "\n";
+    };
+
+    out.precision(15);
+    metric("reconcile_elapsed_seconds", "gauge", "Time since the run started",
+        std::chrono::duration<double>(now - this->started).count());
+    metric("reconcile_files_discovered_total", "counter", "Files found by the walks", discovered);
+    metric("reconcile_bytes_discovered_total", "counter", "Bytes of the files found by the walks", bytesDiscovered);
+    metric("reconcile_files_hashed_total", "counter", "Files read by the hash stage", hashed);
+    metric("reconcile_bytes_hashed_total", "counter", "Bytes read by the hash stage", bytesHashed);
+    metric("reconcile_walks_active", "gauge", "Directory walks still running", walks);
+    metric("reconcile_hash_queue_depth", "gauge", "Hash requests waiting for a thread", hashQueueDepth);
+    metric("reconcile_walk_files_per_second", "gauge", "Files found per second over the last window", discoveredRate);
+    metric("reconcile_hash_files_per_second", "gauge", "Files hashed per second over the last window", hashedRate);
+    metric("reconcile_hash_bytes_per_second", "gauge", "Bytes hashed per second over the last window", bytesHashedRate);
+
+    // Every discovered file gets hashed unless hashing is deferred, the estimate only grows while walks are running
+    if(!this->deferredHashing){
+        unsigned long long backlog = bytesDiscovered > bytesHashed ? bytesDiscovered - bytesHashed : 0;
+        metric("reconcile_hash_backlog_files", "gauge", "Files found but not hashed yet", discovered > hashed ? discovered - hashed : 0);
+        if(bytesHashedRate > 0){
+            metric("reconcile_eta_seconds", "gauge", "Estimated time left to hash what was found so far", backlog / bytesHashedRate);
+        }
+    }
+
+    PipelinePhase phase;
+    {
+        std::lock_guard<std::mutex> guard(this->phaseLock);
+        phase = this->phase;
+    }
+    out << "# HELP reconcile_phase Current stage of the run\n"
+        << "# TYPE reconcile_phase gauge\n";
+    for(int i = 0; i < 5; i++){
+        out << "reconcile_phase{phase=\"" << phaseNames[i] << "\"} " << ((int)phase == i ? 1 : 0) << "\n";
+    }
+
+    return out.str();
+}
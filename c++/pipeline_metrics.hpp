@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+// A counter split into per-thread slots: threads add to their own cache line, readers sum every slot
+class ShardedCounter{
+private:
+    static const size_t slotCount = 64;
+
+    struct alignas(64) Slot{
+        std::atomic<unsigned long long> value{0};
+    };
+
+    Slot slots[slotCount];
+
+    // Slot of the calling thread, threads are spread over the slots in order of first use
+    static size_t threadSlot();
+
+public:
+    void Add(unsigned long long amount){
+        this->slots[threadSlot()].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    unsigned long long Sum() const;
+};
+
+// Stage of a run, as seen from the metrics endpoint
+enum class PipelinePhase{
+    IDLE,
+    SCAN,
+    RECONCILE,
+    MOVES,
+    OUTPUT
+};
+
+// Progress of the scan/hash/reconcile pipeline, cheap to update from any thread and rendered in the
+// Prometheus text format on demand
+class PipelineMetrics{
+private:
+    // Rates are computed over at least this long between two renders
+    static constexpr double rateWindowSeconds = 1.0;
+
+    // Set when the scans only record metadata, hashing then says nothing about the remaining work
+    const bool deferredHashing;
+    const std::chrono::steady_clock::time_point started;
+
+    // Values at the last rate computation, and the rates then
+    std::mutex ratesLock;
+    std::chrono::steady_clock::time_point sampled;
+    unsigned long long sampledDiscovered = 0;
+    unsigned long long sampledHashed = 0;
+    unsigned long long sampledBytesHashed = 0;
+    double discoveredRate = 0;
+    double hashedRate = 0;
+    double bytesHashedRate = 0;
+
+    // Current phase, when it started and the time spent in every phase so far
+    std::mutex phaseLock;
+    PipelinePhase phase = PipelinePhase::IDLE;
+    std::chrono::steady_clock::time_point phaseStarted;
+    double phaseSeconds[5] = {};
+
+public:
+    ShardedCounter FilesDiscovered;
+    ShardedCounter BytesDiscovered;
+    ShardedCounter FilesHashed;
+    ShardedCounter BytesHashed;
+
+    // Walks still running
+    std::atomic<int> WalksActive{0};
+
+    explicit PipelineMetrics(bool deferredHashing);
+
+    // Switches to a phase, entering the current phase again changes nothing
+    void Enter(PipelinePhase phase);
+
+    // Write the wall time spent in every phase that was entered, one "Phase <name>: <seconds> s" line each
+    void PrintTimings(std::ostream& out);
+
+    // Every metric in the Prometheus text exposition format, with the given hash stage queue depth
+    std::string Render(size_t hashQueueDepth);
+};
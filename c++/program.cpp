@@ -7,14 +7,43 @@
 #include "file_result.hpp"
 #include "worker.hpp"
 #include "utils.hpp"
+#include "shard_coordinator.hpp"
+#include "alloc_tracking.hpp"
+#include "metrics_server.hpp"
 
 void PrintUsage(){
     using namespace std;
     cout << endl;
-    cout << "  Usage: program.out [options] <dir_a> <dir_b>" << endl << endl;
+    cout << "  Usage: program.out <dir_a> <dir_b> [<dir_c> ...] [options]" << endl << endl;
+    cout << "  The first directory is reconciled against every other one" << endl << endl;
     cout << "  C++ implementation of the language benchmarking trial" << endl << endl;
     cout << "  Options:" << endl << endl;
     cout << "    -u, --ignore-unchanged\t Ignore unchanged files in the final output" << endl;
+    cout << "    --check\t\t\t Only tell whether the trees are identical, exit status 0 if they are, 1 if not and 2 on errors" << endl;
+    cout << "    --detect-moves\t\t Report files added on both sides with the same content as moves (>)" << endl;
+    cout << "    --move-memory=<bytes>\t Memory allowed to the move detection join [67108864]" << endl;
+    cout << "    --scan-cache=<dir>\t\t Keep every scan in a directory and only read files changed since the previous one" << endl;
+    cout << "    --compress[=<level>]\t Write the patch as reference.patch.gz, compressed in parallel blocks at zlib level 1-9 [1]" << endl;
+    cout << "    --delta[=<file>]\t\t Describe every conflict in matched and changed byte ranges [reference.delta]" << endl;
+    cout << "    --memory-budget=<bytes>\t Keep memory use within a budget by spilling sorted runs to disk (two directories only)" << endl;
+    cout << "    --temp-dir=<dir>\t\t Directory for the runs of --memory-budget [system temporary directory]" << endl;
+    cout << "    --shards=<count>\t\t Scan each directory with <count> worker processes and merge their results (two directories only)" << endl;
+    cout << "    --shard-by=<mode>\t\t Split by top-level entry or by path hash: toplevel or hash [toplevel]" << endl;
+    cout << "    --shard-launcher=<command>\t Prefix running each worker elsewhere, {shard} is replaced by the shard index" << endl;
+    cout << "    --prefilter[=<bytes>]\t Compare head/tail samples before hashing same-size files [4096]" << endl;
+    cout << "    --io-order=<policy>\t Hash read order: walk, inode or extent [inode]" << endl;
+    cout << "    --io-batch=<files>\t\t Files collected before a batch of reads is ordered, 0 for the whole tree [4096]" << endl;
+    cout << "    --hash-threads=<count>\t Threads shared by the hash stage [2]" << endl;
+    cout << "    --auto-tune[=<max>]\t\t Adjust the reads in flight of every directory to its throughput, up to <max> [32]" << endl;
+    cout << "    --tune-window=<ms>\t\t Throughput measurement window of --auto-tune [250]" << endl;
+    cout << "    --read-policy=<policy>\t Page cache policy: default, sequential, dropbehind or direct [default]" << endl;
+    cout << "    --direct-threshold=<bytes>\t Smallest file read with O_DIRECT by the direct policy [16777216]" << endl;
+    cout << "    --io-report\t\t Report the page cache footprint left by hashing" << endl;
+    cout << "    --no-inode-dedupe\t\t Hash every path, even when several are links to the same inode" << endl;
+    cout << "    --include=<glob>\t\t Only reconcile files matching the pattern, may be repeated" << endl;
+    cout << "    --exclude=<glob>\t\t Skip matching files and directories without reading them, '!<glob>' makes an exception" << endl;
+    cout << "    --ignore-file=<file>\t Read exclusions from a file, one pattern per line" << endl;
+    cout << "    --metrics=<port|path>\t Serve live Prometheus metrics on a localhost port or a Unix socket" << endl;
     cout << "    --md5\t\t\t MD5 Hash [Default]" << endl;
     cout << "    --sha1\t\t\t SHA1 Hash" << endl;
     cout << "    --sha256\t\t\t SHA256 Hash" << endl;
@@ -28,20 +57,156 @@ int main(int argc, char** argv){
     if(!args.Parse(argc, argv)){
         std::cout << "Error parsing arguments!" << std::endl;
         PrintUsage();
-        return 1;
+        return 2;
     }
 
-    Worker work(args.Checksum);
-    std::cout << "Starting diff of "<< args.DirectoryA << " and " << args.DirectoryB << " ("
-        << args.Checksum->AlgorithmName() << ")" << std::endl;
+    Worker work(args.Checksum, args.Options);
+
+    // Shard workers only stream their records, stdout carries nothing else
+    if(args.IsShardWorker){
+        try{
+            work.ScanShard(args.DirectoryA.string(), args.ShardIndex, args.ShardCount, stdout);
+        }
+        catch(const std::exception& error){
+            std::cerr << error.what() << std::endl;
+            return 2;
+        }
+
+        return 0;
+    }
+
+    // Served for as long as the run goes on
+    std::unique_ptr<MetricsServer> metrics;
+    if(!args.MetricsEndpoint.empty()){
+        try{
+            metrics.reset(new MetricsServer(args.MetricsEndpoint, [&work]{ return work.RenderMetrics(); }));
+        }
+        catch(const std::exception& error){
+            std::cout << error.what() << std::endl;
+            return 2;
+        }
+    }
+
+    std::string patchFile = args.Options.PatchCompression > 0 ? "reference.patch.gz" : "reference.patch";
+
+    std::vector<std::string> directories;
+    for(auto& directory : args.Directories){
+        directories.push_back(directory.string());
+    }
+
+    std::cout << "Starting diff of "<< args.DirectoryA << " and " << args.DirectoryB;
+    for(size_t replica = 2; replica < args.Directories.size(); replica++){
+        std::cout << ", " << args.Directories[replica];
+    }
+    std::cout << " (" << args.Checksum->AlgorithmName() << ")" << std::endl;
     std::cout << "Start time " << GetFormattedDateTime() << std::endl;
+    std::cout << "Read policy " << FileReader::PolicyName(args.Options.CachePolicy) << std::endl;
+
+    if(args.CheckOnly){
+        bool identical = true;
+        try{
+            for(size_t replica = 1; replica < directories.size() && identical; replica++){
+                identical = work.Check(directories[0], directories[replica]);
+            }
+        }
+        catch(const std::exception& error){
+            // Neither identical nor different, a tree couldn't be walked or read
+            std::cout << "Unable to check the directories: " << error.what() << std::endl;
+            return 2;
+        }
+
+        if(identical){
+            std::cout << "Directories are identical" << std::endl;
+        }
+        else{
+            std::cout << "Directories differ, " << work.Difference() << std::endl;
+        }
+
+        std::cout << std::endl << "End time " << GetFormattedDateTime() << std::endl;
+        work.Stats().Print(std::cout);
+        work.PrintTuning(std::cout);
+        work.PrintTimings(std::cout);
+        PrintAllocations(std::cout);
+        return identical ? 0 : 1;
+    }
 
-    auto promiseA = work.scanDirectory(args.DirectoryA.string());
-    auto promiseB = work.scanDirectory(args.DirectoryB.string());
-    auto resultA = promiseA.get(), resultB = promiseB.get();
-    
-    work.Reconcile(resultA, resultB, true);
-    work.WriteResult(args.DirectoryA.string(), args.DirectoryB.string(), "reference.patch", args.ShouldIgnoreUnchanged);
+    if(args.ShardCount > 0){
+        std::string program = fs::exists("/proc/self/exe") ? fs::read_symlink("/proc/self/exe").string() : argv[0];
+        std::string tempDir = args.Options.TempDirectory.empty()
+            ? fs::temp_directory_path().string()
+            : args.Options.TempDirectory;
+
+        ShardCoordinator coordinator(program, args.ShardLauncher, args.ScanOptions, args.ShardCount);
+        try{
+            coordinator.Reconcile(directories[0], directories[1], patchFile, args.ShouldIgnoreUnchanged, tempDir,
+                (int)args.Options.PatchCompression);
+        }
+        catch(const std::exception& error){
+            // The workers still running were closed while the error unwound
+            std::cout << "Unable to reconcile the directories: " << error.what() << std::endl;
+            return 2;
+        }
+
+        std::cout << std::endl << "End time " << GetFormattedDateTime() << std::endl;
+        PrintAllocations(std::cout);
+        return 0;
+    }
+
+    if(args.Options.MemoryBudget > 0){
+        try{
+            work.ReconcileExternal(directories[0], directories[1], patchFile, args.ShouldIgnoreUnchanged);
+        }
+        catch(const std::exception& error){
+            // Caught so the runs written so far are removed on the way out
+            std::cout << "Unable to reconcile the directories: " << error.what() << std::endl;
+            return 2;
+        }
+
+        std::cout << std::endl << "End time " << GetFormattedDateTime() << std::endl;
+        work.Stats().Print(std::cout);
+        work.PrintTuning(std::cout);
+        work.PrintTimings(std::cout);
+        PrintAllocations(std::cout);
+        return 0;
+    }
+
+    // Scan every root concurrently
+    std::vector<scan_result> results;
+    {
+        AllocPhaseScope phase(AllocPhase::SCAN);
+        std::vector<std::future<scan_result>> promises;
+        for(auto& directory : directories){
+            promises.push_back(work.scanDirectory(directory));
+        }
+
+        for(auto& promise : promises){
+            results.push_back(promise.get());
+        }
+    }
+
+    {
+        AllocPhaseScope phase(AllocPhase::RECONCILE);
+        work.Reconcile(directories, results, true);
+    }
+    if(args.ShouldDetectMoves){
+        AllocPhaseScope phase(AllocPhase::MOVES);
+        work.DetectMoves(directories);
+    }
+    try{
+        AllocPhaseScope phase(AllocPhase::OUTPUT);
+        work.WriteResult(directories, patchFile, args.ShouldIgnoreUnchanged);
+        if(args.Options.ComputeDeltas){
+            work.WriteDeltas(directories, args.DeltaFile);
+        }
+    }
+    catch(const std::exception& error){
+        std::cout << error.what() << std::endl;
+        return 2;
+    }
 
     std::cout << std::endl << "End time " << GetFormattedDateTime() << std::endl;
+    work.Stats().Print(std::cout);
+    work.PrintTuning(std::cout);
+    work.PrintTimings(std::cout);
+    PrintAllocations(std::cout);
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include <future>
+#include <stdexcept>
+
+#include "reconciler.hpp"
+
+Reconciler::Reconciler(std::shared_ptr<ThreadPool> pool, unsigned int hashThreads)
+: pool(pool ? pool : std::make_shared<ThreadPool>(hashThreads)) {}
+
+std::shared_ptr<ThreadPool> Reconciler::Pool() const{
+    return this->pool;
+}
+
+bool Reconciler::Run(const ReconcileOptions& options, ReconcileVisitor& visitor){
+    checksum_ptr checksum = CreateChecksum(options.Checksum);
+    if(!checksum){
+        throw std::invalid_argument("Unknown checksum '" + options.Checksum + "'");
+    }
+    if(options.Directories.size() < 2){
+        throw std::invalid_argument("At least two directories are needed");
+    }
+
+    // Only the command line writes patches, deltas and external or sharded runs, the visitor gets every result
+    const WorkerOptions& pipeline = options.Pipeline;
+    if(pipeline.MemoryBudget > 0 || !pipeline.TempDirectory.empty()){
+        throw std::invalid_argument("External memory reconciles aren't supported, MemoryBudget and TempDirectory must be unset");
+    }
+    if(pipeline.PatchCompression != 0){
+        throw std::invalid_argument("No patch is written, PatchCompression must be 0");
+    }
+    if(pipeline.ShardBy != ShardMode::TOPLEVEL){
+        throw std::invalid_argument("Sharded scans aren't supported, ShardBy must be left unset");
+    }
+    if(pipeline.ComputeDeltas){
+        throw std::invalid_argument("Deltas aren't supported, ComputeDeltas must be false");
+    }
+
+    Worker work(checksum, options.Pipeline, this->pool);
+
+    std::vector<std::future<scan_result>> promises;
+    for(auto& directory : options.Directories){
+        promises.push_back(work.scanDirectory(directory));
+    }
+
+    std::vector<scan_result> results;
+    for(auto& promise : promises){
+        results.push_back(promise.get());
+    }
+
+    // One entry, rewritten for every result, so visiting doesn't allocate
+    ReconcileEntry entry;
+    auto visit = [&](size_t replica, bool toPrimary, ReconcileOperation operation, const FileResultPtr& result){
+        if(operation == ReconcileOperation::UNCHANGED && options.IgnoreUnchanged){
+            return;
+        }
+
+        entry.Replica = replica;
+        entry.Root = toPrimary ? 0 : replica;
+        entry.Operation = operation;
+        entry.Path = result->filepath;
+        entry.Size = result->size;
+        entry.TimeModified = result->timeModified;
+        entry.Digest = result->hash;
+        entry.MovedFrom = result->movedFrom;
+        visitor.Visit(entry);
+    };
+
+    // Moves can only be told once all one-sided files are known, otherwise results stream out of the merge
+    if(options.DetectMoves){
+        work.Reconcile(options.Directories, results, true);
+        work.DetectMoves(options.Directories);
+        work.VisitResult(visit);
+    }
+    else{
+        work.ReconcileTo(options.Directories, results, visit);
+    }
+
+    return work.Stats().ScanCacheFailures == 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+// Embeddable entry point of the scanner/reconciler: link every source but program.cpp
+// (see 'build_library' in run.py) and include this header
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "worker.hpp"
+#include "worker_options.hpp"
+
+// Everything a reconcile needs, no command line involved
+struct ReconcileOptions{
+    // The primary directory first, followed by its replicas
+    std::vector<std::string> Directories;
+
+    // md5, crc32, adler32, sha1 or sha256
+    std::string Checksum = "md5";
+
+    // Skip UNCHANGED results
+    bool IgnoreUnchanged = false;
+
+    // Report one-sided files found under another path on the other side as MOVE
+    bool DetectMoves = false;
+
+    // Scan and hash stage tunables. Reconciles hash on the pool of the Reconciler, so HashThreads is ignored.
+    // The settings of the command line outputs (MemoryBudget, TempDirectory, PatchCompression, ShardBy
+    // and ComputeDeltas) are rejected
+    WorkerOptions Pipeline;
+};
+
+// A single reconcile result. The views point into the scan and are only valid during the visit
+struct ReconcileEntry{
+    // Replica (1-based index into Directories) the primary was compared with
+    size_t Replica;
+
+    // Directory the change applies to: 0 for the primary, Replica for the replica
+    size_t Root;
+
+    ReconcileOperation Operation;
+    std::string_view Path;
+    long Size;
+    std::time_t TimeModified;
+
+    // Empty when the digest was never needed (deferred hashing)
+    std::string_view Digest;
+
+    // For a MOVE, the path holding the same content on the other side
+    std::string_view MovedFrom;
+};
+
+// Receives results as the reconcile produces them
+class ReconcileVisitor{
+public:
+    virtual ~ReconcileVisitor() {}
+
+    virtual void Visit(const ReconcileEntry& entry) = 0;
+};
+
+// Adapts any callable taking a const ReconcileEntry& into a visitor without wrapping it in std::function
+template<typename Callback>
+class CallbackVisitor : public ReconcileVisitor{
+private:
+    Callback callback;
+
+public:
+    explicit CallbackVisitor(Callback callback) : callback(callback) {}
+
+    void Visit(const ReconcileEntry& entry) override{
+        this->callback(entry);
+    }
+};
+
+template<typename Callback>
+CallbackVisitor<Callback> MakeVisitor(Callback callback){
+    return CallbackVisitor<Callback>(callback);
+}
+
+// Runs reconciles, any number of them and from any thread, on one shared hash pool
+class Reconciler{
+private:
+    std::shared_ptr<ThreadPool> pool;
+
+public:
+    // ctor w/ the pool to hash on, shared with other reconcilers or code. Null creates a pool of hashThreads
+    explicit Reconciler(std::shared_ptr<ThreadPool> pool = nullptr, unsigned int hashThreads = 2);
+
+    // Scans every directory and streams the results to the visitor, throws std::invalid_argument on bad options.
+    // Returns false when the scan cache of a directory couldn't be written, the results are complete either way
+    bool Run(const ReconcileOptions& options, ReconcileVisitor& visitor);
+
+    // The pool the reconciles hash on
+    std::shared_ptr<ThreadPool> Pool() const;
+};
@@ -9,7 +9,7 @@ def setup():
         return
 
     # We can't really setup this successfully, we need a build system like CMake or scons for xplat support
-    print("Need to install libboost-filesystem-dev libcrypto++-dev libcrypto++9v5")
+    print("Need to install libboost-filesystem-dev libcrypto++-dev libcrypto++9v5 zlib1g-dev")
     with open('setup.log', 'w') as logFile:
         logFile.write("# This is an autogenerated file made by 'run.py' on {}\n".format(datetime.datetime.now()))
         logFile.write("# => DO NOT DELETE THIS FILE OR SETUP WILL BE CALLED AGAIN\n")
@@ -25,9 +25,13 @@ def build():
         os.remove(output_file_name)
 
     source_files = [x for x in os.listdir('.') if x.endswith('.cpp')]
-    c_libs = ['-lboost_system', '-lboost_filesystem', '-lpthread', '-lcryptopp']
+    c_libs = ['-lboost_system', '-lboost_filesystem', '-lpthread', '-lcryptopp', '-lz']
     c_defs = ['-DNDEBUG', '-DCRYPTOPP_CXX11', '-DCRYPTOPP_CXX11_NOEXCEPT']
 
+    # ALLOC_TRACKING=1 builds in the allocation counters, reported at the end of a run
+    if os.environ.get('ALLOC_TRACKING', '0') not in ('', '0'):
+        c_defs.append('-DALLOC_TRACKING')
+
     # For older versions of clang++/g++, the order of the source files matters!
     process_args = ['clang++'] + source_files + ['-std=c++17',  '-Wall', '-pedantic',  '-Ofast', '-o', output_file_name] + c_libs + c_defs
     subprocess.call(process_args)
@@ -38,9 +42,91 @@ def build():
         raise AssertionError("Build failed")
 #end run
 
+def build_library():
+    import subprocess, os
+
+    # Everything but the command line front end, for embedding through 'reconciler.hpp'
+    library_name = 'libreconcile.a'
+    source_files = [x for x in os.listdir('.') if x.endswith('.cpp') and x != 'program.cpp']
+    c_defs = ['-DNDEBUG', '-DCRYPTOPP_CXX11', '-DCRYPTOPP_CXX11_NOEXCEPT']
+
+    object_files = []
+    for source in source_files:
+        object_file = source[:-len('.cpp')] + '.o'
+        if subprocess.call(['clang++', '-c', source, '-std=c++17', '-Wall', '-pedantic', '-O3', '-fPIC', '-o', object_file] + c_defs) != 0:
+            raise AssertionError("Build failed for '{}'".format(source))
+        object_files.append(object_file)
+
+    if os.path.exists(library_name):
+        os.remove(library_name)
+    subprocess.call(['ar', 'rcs', library_name] + object_files)
+
+    for object_file in object_files:
+        os.remove(object_file)
+
+    print("Built C++ library as '{}' (link with -lboost_system -lboost_filesystem -lpthread -lcryptopp -lz)".format(library_name))
+#end build_library
+
+def build_benchmarks():
+    import subprocess, os
+
+    # Every bench/*.cpp is a standalone program over the sources it names in its header
+    c_defs = ['-DNDEBUG', '-DCRYPTOPP_CXX11', '-DCRYPTOPP_CXX11_NOEXCEPT']
+    benchmarks = {'checksum_bench.cpp': ['fast_checksum.cpp']}
+
+    for benchmark, sources in benchmarks.items():
+        output_name = benchmark[:-len('.cpp')] + '.out'
+        process_args = ['clang++', os.path.join('bench', benchmark)] + sources + ['-I.', '-std=c++17', '-O3', '-o', output_name, '-lcryptopp'] + c_defs
+        if subprocess.call(process_args) != 0:
+            raise AssertionError("Build failed for '{}'".format(benchmark))
+        print("Built benchmark as '{}'".format(output_name))
+#end build_benchmarks
+
+# Every tests/*.cpp is a standalone program over the sources it names, exiting non-zero when a check fails.
+# Tests naming the library are linked against it, as an embedding program would be
+test_sources = {
+    'path_filter_test.cpp': ['path_filter.cpp'],
+    'path_sort_test.cpp': ['path_sort.cpp', 'thread_pool.cpp', 'alloc_tracking.cpp'],
+    'scan_record_test.cpp': ['scan_record.cpp', 'file_result.cpp'],
+    'compressed_output_test.cpp': ['compressed_output.cpp', 'thread_pool.cpp'],
+    'merkle_tree_test.cpp': ['merkle_tree.cpp', 'checksum.cpp', 'fast_checksum.cpp', 'scan_record.cpp', 'file_result.cpp'],
+    'fast_checksum_test.cpp': ['fast_checksum.cpp'],
+    'file_result_test.cpp': ['file_result.cpp'],
+    'reconcile_test.cpp': ['libreconcile.a'],
+}
+
+def build_tests():
+    import subprocess, os
+
+    c_defs = ['-DCRYPTOPP_CXX11', '-DCRYPTOPP_CXX11_NOEXCEPT']
+    if any('libreconcile.a' in sources for sources in test_sources.values()):
+        build_library()
+
+    for test, sources in test_sources.items():
+        output_name = test[:-len('.cpp')] + '.out'
+        process_args = ['clang++', os.path.join('tests', test)] + sources + ['-I.', '-std=c++17', '-Wall', '-pedantic', '-O1', '-o', output_name,
+            '-lboost_system', '-lboost_filesystem', '-lpthread', '-lcryptopp', '-lz'] + c_defs
+        if subprocess.call(process_args) != 0:
+            raise AssertionError("Build failed for '{}'".format(test))
+        print("Built test as '{}'".format(output_name))
+#end build_tests
+
+def run_tests():
+    import subprocess
+
+    failed = [test for test in test_sources if subprocess.call(["./{}".format(test[:-len('.cpp')] + '.out')]) != 0]
+    if failed:
+        raise RuntimeError("Tests failed: {}".format(", ".join(failed)))
+#end run_tests
+
+def command(cmd_args):
+    # The process to start for a run, for harnesses that spawn and measure it themselves
+    return ["./{}".format(output_file_name)] + cmd_args
+#end command
+
 def run(cmd_args):
     import subprocess
-    process_args = ["./{}".format(output_file_name)] + cmd_args
+    process_args = command(cmd_args)
     retcode = subprocess.call(process_args)
     if retcode != 0:
         raise RuntimeError("Program run returned non-zero exit code")
@@ -0,0 +1,95 @@
+#include <cstdint>
+#include <stdexcept>
+
+#include "scan_record.hpp"
+
+namespace{
+    // Buffer given to every record stream
+    const size_t streamBuffer = 64 * 1024;
+
+    bool writeString(std::FILE* stream, const std::string& value){
+        uint32_t length = value.length();
+        return std::fwrite(&length, sizeof(length), 1, stream) == 1
+            && std::fwrite(value.data(), 1, length, stream) == length;
+    }
+
+    bool readString(std::FILE* stream, std::string& value){
+        uint32_t length = 0;
+        if(std::fread(&length, sizeof(length), 1, stream) != 1){
+            return false;
+        }
+
+        value.resize(length);
+        return std::fread(&value[0], 1, length, stream) == length;
+    }
+}
+
+bool WriteRecord(std::FILE* stream, const FileResult& record){
+    int64_t size = record.size, timeModified = record.timeModified;
+    return writeString(stream, record.filepath)
+        && writeString(stream, record.hash)
+        && std::fwrite(&size, sizeof(size), 1, stream) == 1
+        && std::fwrite(&timeModified, sizeof(timeModified), 1, stream) == 1;
+}
+
+RecordReader::RecordReader(std::FILE* stream, bool owned) : stream(stream), owned(owned){
+    std::setvbuf(this->stream, nullptr, _IOFBF, streamBuffer);
+}
+
+RecordReader::RecordReader(const std::string& filepath) : stream(std::fopen(filepath.c_str(), "rb")), owned(true){
+    if(!this->stream){
+        throw std::runtime_error("Unable to open run '" + filepath + "'");
+    }
+
+    std::setvbuf(this->stream, nullptr, _IOFBF, streamBuffer);
+}
+
+RecordReader::~RecordReader(){
+    if(this->owned){
+        std::fclose(this->stream);
+    }
+}
+
+bool RecordReader::Next(FileResult& record){
+    int64_t size = 0, timeModified = 0;
+    if(!readString(this->stream, record.filepath)){
+        return false;
+    }
+
+    if(!readString(this->stream, record.hash)
+        || std::fread(&size, sizeof(size), 1, this->stream) != 1
+        || std::fread(&timeModified, sizeof(timeModified), 1, this->stream) != 1){
+        throw std::runtime_error("Truncated scan record for '" + record.filepath + "'");
+    }
+
+    record.size = size;
+    record.timeModified = timeModified;
+    return true;
+}
+
+MergedRecords::MergedRecords(std::vector<std::unique_ptr<RecordSource>> sources) : sources(std::move(sources)){
+    for(size_t source = 0; source < this->sources.size(); source++){
+        FileResult record;
+        if(this->sources[source]->Next(record)){
+            this->heads.push(head(std::move(record), source));
+        }
+    }
+}
+
+bool MergedRecords::Next(FileResult& record){
+    if(this->heads.empty()){
+        return false;
+    }
+
+    // Copy out of the heap top, priority_queue only hands out const references
+    size_t source = this->heads.top().second;
+    record = this->heads.top().first;
+    this->heads.pop();
+
+    FileResult next;
+    if(this->sources[source]->Next(next)){
+        this->heads.push(head(std::move(next), source));
+    }
+
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "file_result.hpp"
+
+// Compact binary scan records: path, digest, size and modification time of a file.
+// Streams of records are sorted by path wherever they are produced
+
+// Appends one record to a stream
+bool WriteRecord(std::FILE* stream, const FileResult& record);
+
+// A sorted sequence of records
+class RecordSource{
+public:
+    virtual ~RecordSource() {}
+
+    // Reads the next record, false once the source is exhausted
+    virtual bool Next(FileResult& record) = 0;
+};
+
+// Records read from any byte stream: a run file, a pipe or a socket
+class RecordReader : public RecordSource{
+private:
+    std::FILE* stream;
+    const bool owned;
+
+public:
+    // ctor w/ a stream, closed on destruction when owned
+    RecordReader(std::FILE* stream, bool owned);
+
+    // ctor w/ a run file to open
+    explicit RecordReader(const std::string& filepath);
+
+    ~RecordReader();
+
+    RecordReader(const RecordReader&) = delete;
+    RecordReader& operator=(const RecordReader&) = delete;
+
+    bool Next(FileResult& record) override;
+};
+
+// k-way merge of sorted sources into one sorted source
+class MergedRecords : public RecordSource{
+private:
+    typedef std::pair<FileResult, size_t> head;
+
+    struct later{
+        bool operator()(const head& a, const head& b) const{
+            return a.first.filepath > b.first.filepath;
+        }
+    };
+
+    std::vector<std::unique_ptr<RecordSource>> sources;
+    std::priority_queue<head, std::vector<head>, later> heads;
+
+public:
+    // ctor w/ the sources to merge
+    explicit MergedRecords(std::vector<std::unique_ptr<RecordSource>> sources);
+
+    bool Next(FileResult& record) override;
+};
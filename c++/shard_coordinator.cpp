@@ -0,0 +1,117 @@
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+
+#include <sys/wait.h>
+
+#include "shard_coordinator.hpp"
+#include "external_reconcile.hpp"
+#include "scan_record.hpp"
+
+namespace{
+    // Quotes an argument for /bin/sh
+    std::string quote(const std::string& argument){
+        std::string quoted = "'";
+        for(char c : argument){
+            quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+        }
+
+        return quoted + "'";
+    }
+
+    // Records streamed by a worker process, whose exit status is checked once the stream ends
+    class WorkerRecords : public RecordSource{
+    private:
+        std::string command;
+        std::FILE* pipe;
+        std::unique_ptr<RecordReader> reader;
+
+        void finish(){
+            if(!this->pipe){
+                return;
+            }
+
+            this->reader.reset();
+            int status = pclose(this->pipe);
+            this->pipe = nullptr;
+
+            if(status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0){
+                throw std::runtime_error("Shard worker failed: " + this->command);
+            }
+        }
+
+    public:
+        explicit WorkerRecords(const std::string& command) : command(command), pipe(popen(command.c_str(), "r")){
+            if(!this->pipe){
+                throw std::runtime_error("Unable to start shard worker: " + command);
+            }
+
+            this->reader.reset(new RecordReader(this->pipe, false));
+        }
+
+        // A worker left behind by a failure elsewhere is closed too, it stops on its next write to the closed pipe
+        ~WorkerRecords(){
+            if(this->pipe){
+                this->reader.reset();
+                pclose(this->pipe);
+            }
+        }
+
+        bool Next(FileResult& record) override{
+            if(this->pipe && this->reader->Next(record)){
+                return true;
+            }
+
+            this->finish();
+            return false;
+        }
+    };
+}
+
+size_t ShardOf(const std::string& relativePath, size_t count){
+    // FNV-1a, std::hash may differ between the coordinator and remote workers
+    uint64_t hash = 14695981039346656037ull;
+    for(unsigned char c : relativePath){
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+
+    return hash % count;
+}
+
+ShardCoordinator::ShardCoordinator(std::string program, std::string launcher, std::vector<std::string> forwarded, size_t shardCount)
+: program(program), launcher(launcher), forwarded(forwarded), shardCount(shardCount) {}
+
+std::string ShardCoordinator::workerCommand(const std::string& root, size_t index) const{
+    std::string command = quote(this->program) + " " + quote("--shard-worker=" + std::to_string(index) + "/" + std::to_string(this->shardCount))
+        + " " + quote(root);
+    for(auto& option : this->forwarded){
+        command += " " + quote(option);
+    }
+
+    if(this->launcher.empty()){
+        return command;
+    }
+
+    // The launcher gets the whole worker command as its last argument, {shard} picks a node per shard
+    std::string prefix = this->launcher;
+    for(size_t found = prefix.find("{shard}"); found != std::string::npos; found = prefix.find("{shard}")){
+        prefix.replace(found, 7, std::to_string(index));
+    }
+
+    return prefix + " " + quote(command);
+}
+
+void ShardCoordinator::Reconcile(std::string dirA, std::string dirB, std::string destination, bool ignoreUnchanged, std::string tempDir,
+    int compressLevel){
+    // Every worker of both roots is started before any stream is read, so all shards scan concurrently
+    std::vector<std::unique_ptr<RecordSource>> shardsA, shardsB;
+    for(size_t index = 0; index < this->shardCount; index++){
+        shardsA.emplace_back(new WorkerRecords(this->workerCommand(dirA, index)));
+        shardsB.emplace_back(new WorkerRecords(this->workerCommand(dirB, index)));
+    }
+
+    // Shards are disjoint and sorted, merging them yields each root's sorted stream
+    MergedRecords sourceA(std::move(shardsA)), sourceB(std::move(shardsB));
+    WriteStreamedResult(sourceA, sourceB, dirA, dirB, destination, ignoreUnchanged, tempDir, compressLevel);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Stable shard of a root-relative path, the same in every process and on every machine.
+// Top-level sharding passes the top-level entry name, hash sharding the whole path
+size_t ShardOf(const std::string& relativePath, size_t count);
+
+// Scans both trees with one worker process per shard and root, and reconciles the merged record streams
+class ShardCoordinator{
+private:
+    // Binary started for every shard
+    const std::string program;
+
+    // Command prefix running a worker elsewhere (e.g. "ssh node{shard}"), empty to run it locally
+    const std::string launcher;
+
+    // Options handed down to the workers
+    const std::vector<std::string> forwarded;
+
+    const size_t shardCount;
+
+    // Shell command starting the worker of one shard of a root
+    std::string workerCommand(const std::string& root, size_t index) const;
+
+public:
+    // ctor w/ the worker binary, the launcher prefix, the forwarded options and the number of shards
+    ShardCoordinator(std::string program, std::string launcher, std::vector<std::string> forwarded, size_t shardCount);
+
+    // Launch every worker, merge their streams and write the patch, compressed at compressLevel unless it is 0
+    void Reconcile(std::string dirA, std::string dirB, std::string destination, bool ignoreUnchanged, std::string tempDir,
+        int compressLevel = 0);
+};
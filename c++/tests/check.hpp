@@ -0,0 +1,31 @@
+#pragma once
+
+#include <iostream>
+
+// Minimal checks shared by the tests/*.cpp programs: every failed CHECK is reported with its line,
+// and the number of failures is the exit status of the program
+
+// Failed checks so far
+inline int& FailedChecks(){
+    static int failed = 0;
+    return failed;
+}
+
+#define CHECK(condition) \
+    do{ \
+        if(!(condition)){ \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+            FailedChecks()++; \
+        } \
+    } while(false)
+
+// Exit status of a test program, also saying how it went
+inline int CheckResult(const char* name){
+    if(FailedChecks() == 0){
+        std::cout << name << ": passed" << std::endl;
+    }
+    else{
+        std::cout << name << ": " << FailedChecks() << " checks failed" << std::endl;
+    }
+    return FailedChecks() == 0 ? 0 : 1;
+}
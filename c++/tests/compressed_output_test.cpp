@@ -0,0 +1,151 @@
+// CompressedBuffer and the patch outputs, decompressed again through zlib
+//
+// Build and run from the c++ directory:
+//   clang++ -std=c++17 tests/compressed_output_test.cpp compressed_output.cpp thread_pool.cpp -I.
+//       -lboost_system -lboost_filesystem -lpthread -lz -o compressed_output_test.out
+//   ./compressed_output_test.out
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <zlib.h>
+
+#include "compressed_output.hpp"
+#include "check.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace{
+    const std::string testFile = "compressed_output_test.gz";
+
+    // Whole content of a gzip file, every member of it
+    std::string gunzip(const std::string& path){
+        gzFile file = gzopen(path.c_str(), "rb");
+        std::string content;
+        char buffer[4096];
+        int read = 0;
+        while(file && (read = gzread(file, buffer, sizeof(buffer))) > 0){
+            content.append(buffer, read);
+        }
+        if(file){
+            gzclose(file);
+        }
+        return content;
+    }
+
+    // Text compressing a little, with a sprinkle of random bytes
+    std::string makeText(size_t length, unsigned int seed){
+        std::mt19937 random(seed);
+        std::string text;
+        while(text.length() < length){
+            text += "= some/path/file" + std::to_string(random() % 1000) + " (2026-10-19 07:36:46 | 5 bytes)\n";
+            if(random() % 8 == 0){
+                text += (char)random();
+            }
+        }
+        text.resize(length);
+        return text;
+    }
+
+    // Writes the text through a buffer of the given block size, in pieces of the given length
+    void checkRoundTrip(const std::string& text, size_t blockSize, unsigned int threads, size_t piece){
+        {
+            CompressedBuffer buffer(testFile, 6, threads, blockSize);
+            std::ostream output(&buffer);
+            for(size_t offset = 0; offset < text.length(); offset += piece){
+                output.write(text.data() + offset, std::min(piece, text.length() - offset));
+            }
+            output.flush();
+
+            CHECK(buffer.Close());
+            CHECK(!buffer.IsOpen());
+            CHECK(buffer.BytesIn() == text.length());
+            CHECK(buffer.BytesOut() == fs::file_size(testFile));
+        }
+
+        CHECK(gunzip(testFile) == text);
+        fs::remove(testFile);
+    }
+
+    void testRoundTrips(){
+        checkRoundTrip("", 1024, 2, 1);
+        checkRoundTrip("one line\n", 1024, 2, 100);
+
+        // Exactly one block, one byte more, and many blocks compressed concurrently and written in order
+        checkRoundTrip(makeText(1024, 1), 1024, 2, 7);
+        checkRoundTrip(makeText(1025, 2), 1024, 2, 1025);
+        checkRoundTrip(makeText(300000, 3), 1000, 4, 333);
+        checkRoundTrip(makeText(3 * 1024 * 1024 + 17, 4), 1024 * 1024, 3, 65536);
+    }
+
+    void testPatchOutputs(){
+        std::string text = makeText(200000, 5);
+
+        // Compressed, through the same calls as the patch writers
+        {
+            auto output = OpenPatchOutput(testFile, 1);
+            *output << text;
+            PatchSize size = ClosePatchOutput(*output, testFile);
+            CHECK(size.Text == text.length());
+            CHECK(size.Stored == fs::file_size(testFile));
+            CHECK(size.Stored < size.Text);
+        }
+        CHECK(gunzip(testFile) == text);
+
+        // Plain text at level 0
+        {
+            auto output = OpenPatchOutput(testFile, 0);
+            *output << text;
+            PatchSize size = ClosePatchOutput(*output, testFile);
+            CHECK(size.Text == text.length() && size.Stored == text.length());
+        }
+        std::ifstream plain(testFile);
+        CHECK(std::string(std::istreambuf_iterator<char>(plain), std::istreambuf_iterator<char>()) == text);
+        fs::remove(testFile);
+    }
+
+    void testWriteErrors(){
+        // A destination that can't be created fails when opened and again when closed
+        std::string missing = "compressed_output_test.missing/patch.gz";
+        CompressedBuffer unopened(missing, 1, 1);
+        CHECK(!unopened.IsOpen());
+        CHECK(!unopened.Close());
+
+        bool threw = false;
+        try{
+            auto output = OpenPatchOutput(missing, 1);
+            ClosePatchOutput(*output, missing);
+        }
+        catch(const std::runtime_error&){
+            threw = true;
+        }
+        CHECK(threw);
+
+        // A device refusing every write: the error shows up when the blocks are flushed and closed
+        if(fs::exists("/dev/full")){
+            threw = false;
+            try{
+                auto output = OpenPatchOutput("/dev/full", 1);
+                *output << makeText(100000, 6);
+                ClosePatchOutput(*output, "/dev/full");
+            }
+            catch(const std::runtime_error&){
+                threw = true;
+            }
+            CHECK(threw);
+        }
+    }
+}
+
+int main(){
+    testRoundTrips();
+    testPatchOutputs();
+    testWriteErrors();
+
+    return CheckResult("compressed_output_test");
+}
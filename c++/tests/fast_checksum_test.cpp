@@ -0,0 +1,107 @@
+// CRC32 and Adler32 kernels of fast_checksum.hpp against zlib's crc32() and adler32(), over every short length,
+// unaligned starts and uneven updates. Only the kernels picked for the CPU running the test are exercised
+//
+// Build and run from the c++ directory:
+//   clang++ -std=c++17 tests/fast_checksum_test.cpp fast_checksum.cpp -I. -lcryptopp -lz -o fast_checksum_test.out
+//   ./fast_checksum_test.out
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <zlib.h>
+
+#include "fast_checksum.hpp"
+#include "check.hpp"
+
+namespace{
+    // Digest layouts: CRC32 little endian, Adler32 big endian, as Crypto++ writes them
+    uint32_t crcOf(FastCRC32& checksum){
+        unsigned char digest[4];
+        checksum.Final(digest);
+        return digest[0] | (digest[1] << 8) | (digest[2] << 16) | ((uint32_t)digest[3] << 24);
+    }
+
+    uint32_t adlerOf(FastAdler32& checksum){
+        unsigned char digest[4];
+        checksum.Final(digest);
+        return ((uint32_t)digest[0] << 24) | (digest[1] << 16) | (digest[2] << 8) | digest[3];
+    }
+
+    // Checks both kernels on a range fed in pieces of at most maxPiece bytes (the whole range when 0)
+    bool matches(const unsigned char* data, size_t length, size_t maxPiece, std::mt19937& random){
+        FastCRC32 crc;
+        FastAdler32 adler;
+        for(size_t offset = 0; offset < length; ){
+            size_t piece = maxPiece == 0 ? length : std::min(length - offset, 1 + random() % maxPiece);
+            crc.Update(data + offset, piece);
+            adler.Update(data + offset, piece);
+            offset += piece;
+        }
+
+        uint32_t expectedCrc = crc32(crc32(0, nullptr, 0), data, length);
+        uint32_t expectedAdler = adler32(adler32(0, nullptr, 0), data, length);
+        return crcOf(crc) == expectedCrc && adlerOf(adler) == expectedAdler;
+    }
+
+    void testShortLengths(const std::vector<unsigned char>& buffer, std::mt19937& random){
+        // Every length around the vector widths and folding blocks, from every alignment
+        bool all = true;
+        for(size_t length = 0; length <= 512; length++){
+            for(size_t start = 0; start < 16; start++){
+                all = all && matches(buffer.data() + start, length, 0, random);
+            }
+        }
+        CHECK(all);
+    }
+
+    void testLongAndSplit(const std::vector<unsigned char>& buffer, std::mt19937& random){
+        CHECK(matches(buffer.data(), buffer.size(), 0, random));
+        CHECK(matches(buffer.data() + 3, buffer.size() - 7, 0, random));
+
+        // Updates of any size must give the digest of the whole range
+        CHECK(matches(buffer.data() + 1, buffer.size() - 1, 7, random));
+        CHECK(matches(buffer.data(), buffer.size(), 100000, random));
+    }
+
+    void testSaturatedInput(std::mt19937& random){
+        // All 0xFF bytes push the Adler32 sums to their largest values before every modulo
+        std::vector<unsigned char> ones(3 * 5552 + 101, 0xFF);
+        CHECK(matches(ones.data(), ones.size(), 0, random));
+        CHECK(matches(ones.data(), ones.size(), 5553, random));
+
+        std::vector<unsigned char> zeros(70000, 0);
+        CHECK(matches(zeros.data(), zeros.size(), 0, random));
+    }
+
+    void testRestart(const std::vector<unsigned char>& buffer){
+        // Final resets the state, a second digest over the same data is the same
+        FastCRC32 crc;
+        FastAdler32 adler;
+        crc.Update(buffer.data(), 1000);
+        adler.Update(buffer.data(), 1000);
+        uint32_t firstCrc = crcOf(crc), firstAdler = adlerOf(adler);
+
+        crc.Update(buffer.data(), 1000);
+        adler.Update(buffer.data(), 1000);
+        CHECK(crcOf(crc) == firstCrc);
+        CHECK(adlerOf(adler) == firstAdler);
+    }
+}
+
+int main(){
+    std::mt19937 random(7);
+    std::vector<unsigned char> buffer(3 * 1024 * 1024 + 13);
+    for(auto& value : buffer){
+        value = (unsigned char)random();
+    }
+
+    std::cout << "CRC32 kernel " << FastCRC32::Implementation() << ", Adler32 kernel " << FastAdler32::Implementation() << std::endl;
+    testShortLengths(buffer, random);
+    testLongAndSplit(buffer, random);
+    testSaturatedInput(random);
+    testRestart(buffer);
+
+    return CheckResult("fast_checksum_test");
+}
@@ -0,0 +1,41 @@
+// Metadata and full equality of FileResult, in both directions
+//
+// Build and run from the c++ directory:
+//   clang++ -std=c++17 tests/file_result_test.cpp file_result.cpp -I. -o file_result_test.out && ./file_result_test.out
+
+#include "file_result.hpp"
+#include "check.hpp"
+
+namespace{
+    const std::time_t older = 1500000000;
+
+    void testMetadata(){
+        FileResult a("f", "AA", 4, older), b("f", "BB", 4, older);
+        CHECK(a.metadataMatches(b) && b.metadataMatches(a));
+
+        // A different modification time differs whichever side is newer
+        FileResult newer("f", "AA", 4, older + 1);
+        CHECK(!a.metadataMatches(newer));
+        CHECK(!newer.metadataMatches(a));
+
+        FileResult bigger("f", "AA", 5, older), moved("g", "AA", 4, older);
+        CHECK(!a.metadataMatches(bigger) && !bigger.metadataMatches(a));
+        CHECK(!a.metadataMatches(moved) && !moved.metadataMatches(a));
+    }
+
+    void testEquality(){
+        FileResult a("f", "AA", 4, older), same("f", "AA", 4, older);
+        CHECK(a == same && same == a);
+
+        FileResult other("f", "BB", 4, older), newer("f", "AA", 4, older + 100);
+        CHECK(!(a == other) && !(other == a));
+        CHECK(!(a == newer) && !(newer == a));
+    }
+}
+
+int main(){
+    testMetadata();
+    testEquality();
+
+    return CheckResult("file_result_test");
+}
@@ -0,0 +1,132 @@
+// ScanCache Save/Load and the directory digests of BuildDirectoryDigests
+//
+// Build and run from the c++ directory:
+//   clang++ -std=c++17 tests/merkle_tree_test.cpp merkle_tree.cpp checksum.cpp fast_checksum.cpp scan_record.cpp file_result.cpp -I.
+//       -lboost_system -lboost_filesystem -lcryptopp -o merkle_tree_test.out
+//   ./merkle_tree_test.out
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "merkle_tree.hpp"
+#include "check.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace{
+    const std::string cacheDirectory = "merkle_tree_test.cache";
+
+    // Modification time of every test file, well before the scan time
+    const std::time_t modified = 1500000000;
+    const std::time_t scanned = 1600000000;
+
+    std::vector<FileResultPtr> makeFiles(){
+        return {
+            std::make_shared<FileResult>("a/one", "11", 1, modified),
+            std::make_shared<FileResult>("a/sub/two", "22", 2, modified),
+            std::make_shared<FileResult>("b/three", "33", 3, modified),
+            std::make_shared<FileResult>("deferred", "", 4, modified),
+            std::make_shared<FileResult>("recent", "55", 5, scanned)
+        };
+    }
+
+    void testSaveLoad(){
+        std::string path = ScanCache::PathFor(cacheDirectory + "/nested", "/some/root");
+        auto files = makeFiles();
+        CHECK(ScanCache::Save(path, "MD5", files, scanned));
+        CHECK(fs::exists(path) && !fs::exists(path + ".partial"));
+
+        ScanCache cache;
+        CHECK(cache.Load(path, "MD5"));
+
+        // Files without a digest aren't kept
+        CHECK(cache.Size() == 4);
+        CHECK(cache.Digest(*files[0]) == "11");
+        CHECK(cache.Digest(*files[1]) == "22");
+        CHECK(cache.Digest(*files[3]).empty());
+
+        // Changed size or time, unknown paths and files modified once the scan started all need a read
+        CHECK(cache.Digest(FileResult("a/one", "", 2, modified)).empty());
+        CHECK(cache.Digest(FileResult("a/one", "", 1, modified + 1)).empty());
+        CHECK(cache.Digest(FileResult("a/none", "", 1, modified)).empty());
+        CHECK(cache.Digest(*files[4]).empty());
+
+        // Another algorithm's digests are useless
+        ScanCache other;
+        CHECK(!other.Load(path, "SHA-256"));
+        CHECK(other.Size() == 0);
+
+        // Saving again replaces the previous cache
+        files.pop_back();
+        files[0]->hash = "99";
+        CHECK(ScanCache::Save(path, "MD5", files, scanned));
+        CHECK(cache.Load(path, "MD5"));
+        CHECK(cache.Size() == 3);
+        CHECK(cache.Digest(*files[0]) == "99");
+    }
+
+    void testMissingAndCorrupt(){
+        ScanCache cache;
+        CHECK(!cache.Load(cacheDirectory + "/missing.scan", "MD5"));
+
+        std::string corrupt = cacheDirectory + "/corrupt.scan";
+        {
+            // A header cut right after its path
+            std::ofstream output(corrupt, std::ios::binary);
+            output.write("\x03\0\0\0abc", 7);
+        }
+        CHECK(!cache.Load(corrupt, "MD5"));
+        CHECK(cache.Size() == 0);
+    }
+
+    void testPathFor(){
+        std::string first = ScanCache::PathFor(cacheDirectory, "/one/root");
+        CHECK(first == ScanCache::PathFor(cacheDirectory, "/one/root"));
+        CHECK(first != ScanCache::PathFor(cacheDirectory, "/another/root"));
+        CHECK(fs::path(first).parent_path() == fs::path(cacheDirectory));
+        CHECK(fs::path(first).extension() == ".scan");
+    }
+
+    void testDirectoryDigests(){
+        auto files = makeFiles();
+        files.erase(files.begin() + 3);
+        auto same = makeFiles();
+        same.erase(same.begin() + 3);
+
+        directory_digests digests = BuildDirectoryDigests(files);
+        CHECK(digests.count("") && digests.count("a") && digests.count("a/sub") && digests.count("b"));
+        CHECK(digests[""].files == 4 && digests["a"].files == 2 && digests["a/sub"].files == 1);
+        CHECK(digests["a"].digest.length() == 32);
+        CHECK(BuildDirectoryDigests(same)[""].digest == digests[""].digest);
+
+        // A change deep down reaches every directory above it, and only those
+        same[1]->hash = "changed";
+        directory_digests changed = BuildDirectoryDigests(same);
+        CHECK(changed["a/sub"].digest != digests["a/sub"].digest);
+        CHECK(changed["a"].digest != digests["a"].digest);
+        CHECK(changed[""].digest != digests[""].digest);
+        CHECK(changed["b"].digest == digests["b"].digest);
+
+        // A file without a digest leaves its directories without one
+        same[1]->hash.clear();
+        directory_digests incomplete = BuildDirectoryDigests(same);
+        CHECK(incomplete["a/sub"].digest.empty() && incomplete["a"].digest.empty() && incomplete[""].digest.empty());
+        CHECK(incomplete["b"].digest == digests["b"].digest);
+    }
+}
+
+int main(){
+    fs::remove_all(cacheDirectory);
+    fs::create_directories(cacheDirectory);
+
+    testSaveLoad();
+    testMissingAndCorrupt();
+    testPathFor();
+    testDirectoryDigests();
+
+    fs::remove_all(cacheDirectory);
+    return CheckResult("merkle_tree_test");
+}
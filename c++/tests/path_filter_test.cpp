@@ -0,0 +1,126 @@
+// Glob matching of the include/exclude patterns of PathFilter
+//
+// Build and run from the c++ directory:
+//   clang++ -std=c++17 tests/path_filter_test.cpp path_filter.cpp -I. -o path_filter_test.out && ./path_filter_test.out
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "path_filter.hpp"
+#include "check.hpp"
+
+namespace{
+    // Whether a filter made of these exclusions keeps an entry
+    bool keeps(const std::vector<std::string>& exclusions, const std::string& path, bool isDirectory = false){
+        PathFilter filter;
+        for(auto& glob : exclusions){
+            filter.Exclude(glob);
+        }
+        return filter.Keeps(path, isDirectory);
+    }
+
+    void testNames(){
+        // Without a '/' a pattern matches the name at any depth
+        CHECK(!keeps({"*.o"}, "a.o"));
+        CHECK(!keeps({"*.o"}, "src/deep/b.o"));
+        CHECK(keeps({"*.o"}, "a.oo"));
+        CHECK(keeps({"*.o"}, "a.o/readme"));
+        CHECK(!keeps({"Makefile"}, "sub/Makefile"));
+        CHECK(keeps({"Makefile"}, "sub/Makefile.am"));
+    }
+
+    void testWildcards(){
+        CHECK(!keeps({"file?.txt"}, "file1.txt"));
+        CHECK(keeps({"file?.txt"}, "file12.txt"));
+        CHECK(keeps({"file?.txt"}, "file.txt"));
+
+        CHECK(!keeps({"[a-c]*.tmp"}, "b1.tmp"));
+        CHECK(keeps({"[a-c]*.tmp"}, "d1.tmp"));
+        CHECK(!keeps({"[!a]x"}, "bx"));
+        CHECK(keeps({"[!a]x"}, "ax"));
+
+        // '*' and '?' stay within a component
+        CHECK(!keeps({"a/*/c"}, "a/b/c"));
+        CHECK(keeps({"a/*/c"}, "a/b/d/c"));
+        CHECK(keeps({"a?b"}, "a/b"));
+
+        // An escaped wildcard is a literal
+        CHECK(!keeps({"\\*star"}, "*star"));
+        CHECK(keeps({"\\*star"}, "xstar"));
+    }
+
+    void testGlobstars(){
+        CHECK(!keeps({"src/**/gen"}, "src/gen", true));
+        CHECK(!keeps({"src/**/gen"}, "src/a/b/gen", true));
+        CHECK(keeps({"src/**/gen"}, "lib/gen", true));
+
+        CHECK(!keeps({"**/cache"}, "cache", true));
+        CHECK(!keeps({"**/cache"}, "x/y/cache", true));
+
+        CHECK(!keeps({"logs/**"}, "logs/a/b"));
+        CHECK(keeps({"logs/**"}, "logs", true));
+    }
+
+    void testAnchorsAndDirectories(){
+        // A leading or inner '/' anchors the pattern at the root
+        CHECK(!keeps({"/docs"}, "docs", true));
+        CHECK(keeps({"/docs"}, "src/docs", true));
+
+        // A trailing '/' only matches directories
+        CHECK(!keeps({"build/"}, "build", true));
+        CHECK(!keeps({"build/"}, "src/build", true));
+        CHECK(keeps({"build/"}, "build", false));
+    }
+
+    void testExceptionsAndInclusions(){
+        // The last matching pattern wins
+        CHECK(!keeps({"*.log", "!keep.log"}, "x.log"));
+        CHECK(keeps({"*.log", "!keep.log"}, "keep.log"));
+        CHECK(keeps({"*.log", "!keep.log"}, "d/keep.log"));
+        CHECK(!keeps({"!keep.log", "*.log"}, "keep.log"));
+
+        PathFilter filter;
+        CHECK(filter.Empty());
+        filter.Include("*.cpp");
+        CHECK(!filter.Empty());
+        CHECK(filter.Keeps("src/a.cpp", false));
+        CHECK(!filter.Keeps("src/a.hpp", false));
+
+        // Directories are always walked, inclusions only pick files
+        CHECK(filter.Keeps("src", true));
+
+        filter.Exclude("skip/");
+        CHECK(!filter.Keeps("skip", true));
+        CHECK(!filter.Keeps("b.hpp", false));
+    }
+
+    void testIgnoreFile(){
+        std::string path = "path_filter_test.ignore";
+        {
+            std::ofstream ignore(path);
+            ignore << "# a comment\n*.bak \r\n\n!x.bak\n";
+        }
+
+        PathFilter filter;
+        CHECK(filter.LoadIgnoreFile(path));
+        CHECK(!filter.Keeps("a.bak", false));
+        CHECK(filter.Keeps("x.bak", false));
+        CHECK(filter.Keeps("# a comment", false));
+        std::remove(path.c_str());
+
+        CHECK(!filter.LoadIgnoreFile("path_filter_test.missing"));
+    }
+}
+
+int main(){
+    testNames();
+    testWildcards();
+    testGlobstars();
+    testAnchorsAndDirectories();
+    testExceptionsAndInclusions();
+    testIgnoreFile();
+
+    return CheckResult("path_filter_test");
+}
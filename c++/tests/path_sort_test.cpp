@@ -0,0 +1,106 @@
+// SortPaths and SortByPath against std::sort, serial and shared with a thread pool
+//
+// Build and run from the c++ directory:
+//   clang++ -std=c++17 tests/path_sort_test.cpp path_sort.cpp thread_pool.cpp alloc_tracking.cpp -I. -lpthread -o path_sort_test.out
+//   ./path_sort_test.out
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "path_sort.hpp"
+#include "thread_pool.hpp"
+#include "check.hpp"
+
+namespace{
+    // Paths sharing long directory prefixes, with duplicates, prefixes of each other and bytes above 0x7F
+    std::vector<std::string> makePaths(size_t count, unsigned int seed){
+        std::mt19937 random(seed);
+        std::vector<std::string> directories = {"", "src/", "src/sub/", "src/sub/deeper/and/deeper/", "b/", "\xC3\xA9t\xC3\xA9/"};
+        std::vector<std::string> paths;
+
+        for(size_t i = 0; i < count; i++){
+            std::string path = directories[random() % directories.size()];
+            size_t length = random() % 12;
+            for(size_t c = 0; c < length; c++){
+                // Mostly a small alphabet so neighbours share prefixes, sometimes any non-zero byte
+                path += random() % 8 == 0 ? (char)(1 + random() % 255) : (char)('a' + random() % 4);
+            }
+            paths.push_back(path);
+
+            if(random() % 16 == 0){
+                paths.push_back(path);
+            }
+        }
+
+        return paths;
+    }
+
+    // Sorts the paths with SortPaths, checks the order against std::sort and that every entry is still there once
+    void checkSort(const std::vector<std::string>& paths, ThreadPool* pool){
+        std::vector<PathSortEntry> entries;
+        for(size_t i = 0; i < paths.size(); i++){
+            entries.push_back(PathSortEntry{paths[i].data(), paths[i].length(), i});
+        }
+        SortPaths(entries, pool);
+
+        std::vector<std::string> expected = paths;
+        std::sort(expected.begin(), expected.end());
+
+        CHECK(entries.size() == paths.size());
+        std::vector<bool> seen(paths.size(), false);
+        bool ordered = true, distinct = true;
+        for(size_t i = 0; i < entries.size() && i < expected.size(); i++){
+            ordered = ordered && std::string(entries[i].path, entries[i].length) == expected[i];
+            distinct = distinct && entries[i].index < paths.size() && !seen[entries[i].index];
+            if(entries[i].index < paths.size()){
+                seen[entries[i].index] = true;
+            }
+        }
+        CHECK(ordered);
+        CHECK(distinct);
+    }
+
+    void testSmall(){
+        checkSort({}, nullptr);
+        checkSort({"only"}, nullptr);
+        checkSort({"b", "a", "", "ab", "a/b", "a-b", "a", "aa"}, nullptr);
+        checkSort(makePaths(100, 1), nullptr);
+        checkSort(makePaths(5000, 2), nullptr);
+    }
+
+    void testLarge(){
+        // Above the parallel threshold, serial, with a single thread pool (serial too) and shared with a pool
+        std::vector<std::string> paths = makePaths(200000, 3);
+        checkSort(paths, nullptr);
+
+        ThreadPool single(1);
+        checkSort(paths, &single);
+
+        ThreadPool pool(4);
+        checkSort(paths, &pool);
+        checkSort(makePaths(70000, 4), &pool);
+
+        // The pool is still usable once a sort returns, late tasks found nothing left to do
+        checkSort(makePaths(100000, 5), &pool);
+    }
+
+    void testSortByPath(){
+        std::vector<std::string> items = makePaths(80000, 6);
+        std::vector<std::string> expected = items;
+        std::sort(expected.begin(), expected.end());
+
+        ThreadPool pool(3);
+        SortByPath(items, [](const std::string& item) -> const std::string& { return item; }, &pool);
+        CHECK(items == expected);
+    }
+}
+
+int main(){
+    testSmall();
+    testLarge();
+    testSortByPath();
+
+    return CheckResult("path_sort_test");
+}
@@ -0,0 +1,392 @@
+// Reconciles of small generated trees, run through the Worker and the Reconciler as the command line runs them.
+// The sharded reconcile starts this test again as its shard workers
+//
+// Build and run from the c++ directory, over the library built by 'build_library' in run.py:
+//   clang++ -std=c++17 tests/reconcile_test.cpp libreconcile.a -I.
+//       -lboost_system -lboost_filesystem -lpthread -lcryptopp -lz -o reconcile_test.out
+//   ./reconcile_test.out
+
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "argument_holder.hpp"
+#include "reconciler.hpp"
+#include "shard_coordinator.hpp"
+#include "check.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace{
+    const std::string treeDirectory = "reconcile_test.trees";
+
+    // Modification time of every generated file unless a test asks for another one
+    const std::time_t modified = 1500000000;
+
+    // Bytes that differ between seeds from the first one on
+    std::string makeContent(size_t length, unsigned int seed){
+        std::mt19937 random(seed);
+        std::string content(length, '\0');
+        for(auto& value : content){
+            value = (char)random();
+        }
+        return content;
+    }
+
+    // Writes a file of a generated tree, creating its directories
+    void writeFile(const std::string& root, const std::string& path, const std::string& content, std::time_t time = modified){
+        fs::path filepath = fs::path(treeDirectory) / root / path;
+        fs::create_directories(filepath.parent_path());
+        {
+            std::ofstream output(filepath.string(), std::ios::binary);
+            output << content;
+        }
+        fs::last_write_time(filepath, time);
+    }
+
+    // Path of a generated root, as the directories are handed to the worker
+    std::string rootOf(const std::string& root){
+        return (fs::path(treeDirectory) / root).string();
+    }
+
+    // One line per result: the replica, the side the change applies to, the operation and the path
+    std::string describe(size_t replica, bool toPrimary, ReconcileOperation operation, const FileResult& entry){
+        return std::to_string(replica) + (toPrimary ? " primary " : " replica ") + (char)operation + " " + entry.filepath;
+    }
+
+    // Scans the roots and reconciles them, the results in the order the sink got them
+    std::vector<std::string> reconcile(Worker& work, const std::vector<std::string>& roots){
+        std::vector<std::future<scan_result>> scans;
+        for(auto& root : roots){
+            scans.push_back(work.scanDirectory(root));
+        }
+
+        std::vector<scan_result> results;
+        for(auto& scan : scans){
+            results.push_back(scan.get());
+        }
+
+        std::vector<std::string> lines;
+        work.ReconcileTo(roots, results, [&](size_t replica, bool toPrimary, ReconcileOperation operation, const FileResultPtr& entry){
+            lines.push_back(describe(replica, toPrimary, operation, *entry));
+        });
+        return lines;
+    }
+
+    void testDeferredHashing(){
+        // Sizes and times alike everywhere but in 'size', the samples only tell 'head' apart
+        writeFile("deferred/A", "same", makeContent(20000, 1));
+        writeFile("deferred/B", "same", makeContent(20000, 1));
+        writeFile("deferred/A", "head", makeContent(20000, 2));
+        writeFile("deferred/B", "head", makeContent(20000, 3));
+        std::string middle = makeContent(20000, 4);
+        writeFile("deferred/A", "middle", middle);
+        middle[10000] ^= 1;
+        writeFile("deferred/B", "middle", middle);
+        writeFile("deferred/A", "size", makeContent(100, 5));
+        writeFile("deferred/B", "size", makeContent(101, 5));
+        writeFile("deferred/A", "sub/onlyA", makeContent(10, 6));
+        writeFile("deferred/B", "sub/onlyB", makeContent(10, 7));
+        const std::vector<std::string> roots = {rootOf("deferred/A"), rootOf("deferred/B")};
+
+        Worker eager(CreateChecksum("md5"));
+        std::vector<std::string> expected = reconcile(eager, roots);
+        CHECK(eager.Stats().FilesHashed == 10);
+        CHECK(expected == std::vector<std::string>({
+            "1 primary ! head", "1 replica ! head",
+            "1 primary ! middle", "1 replica ! middle",
+            "1 primary = same", "1 replica = same",
+            "1 primary ! size", "1 replica ! size",
+            "1 replica + sub/onlyA",
+            "1 primary + sub/onlyB"
+        }));
+
+        // Same results in the same order, but only the pairs the samples couldn't tell apart are read in full,
+        // whether they are settled all at once or one batch at a time
+        for(long window : {0L, 1L}){
+            WorkerOptions options;
+            options.PrefilterBytes = 4096;
+            options.BatchWindow = window;
+            Worker deferred(CreateChecksum("md5"), options);
+
+            CHECK(reconcile(deferred, roots) == expected);
+            CHECK(deferred.Stats().PrefilterPairs == 3);
+            CHECK(deferred.Stats().PrefilterConflicts == 1);
+            CHECK(deferred.Stats().FilesHashed == 4);
+        }
+    }
+
+    void testInodeDedupe(){
+        // One inode under four paths, two in either tree, and a file of its own
+        writeFile("links/A", "data", makeContent(50000, 8));
+        writeFile("links/A", "other", makeContent(50000, 9));
+        fs::create_directories(fs::path(rootOf("links/B")) / "sub");
+        fs::create_hard_link(fs::path(rootOf("links/A")) / "data", fs::path(rootOf("links/A")) / "link");
+        fs::create_hard_link(fs::path(rootOf("links/A")) / "data", fs::path(rootOf("links/B")) / "data");
+        fs::create_hard_link(fs::path(rootOf("links/A")) / "data", fs::path(rootOf("links/B")) / "sub/link");
+        const std::vector<std::string> roots = {rootOf("links/A"), rootOf("links/B")};
+
+        Worker shared(CreateChecksum("md5"));
+        std::vector<std::string> lines = reconcile(shared, roots);
+        CHECK(lines == std::vector<std::string>({
+            "1 primary = data", "1 replica = data",
+            "1 replica + link",
+            "1 replica + other",
+            "1 primary + sub/link"
+        }));
+        CHECK(shared.Stats().FilesHashed == 2);
+        CHECK(shared.Stats().FilesDeduplicated == 3);
+        CHECK(shared.Stats().BytesDeduplicated == 150000);
+
+        // Without the dedupe every path is read, for the same results
+        WorkerOptions options;
+        options.DedupeInodes = false;
+        Worker separate(CreateChecksum("md5"), options);
+        CHECK(reconcile(separate, roots) == lines);
+        CHECK(separate.Stats().FilesHashed == 5);
+        CHECK(separate.Stats().FilesDeduplicated == 0);
+    }
+
+    // Runs Check in both argument orders on a fresh worker, the difference it reported is kept when there is one
+    bool checkBothWays(const std::string& a, const std::string& b, std::string* difference = nullptr){
+        Worker forward(CreateChecksum("md5")), backward(CreateChecksum("md5"));
+        bool identical = forward.Check(rootOf(a), rootOf(b));
+        CHECK(backward.Check(rootOf(b), rootOf(a)) == identical);
+        if(difference){
+            *difference = forward.Difference();
+        }
+        return identical;
+    }
+
+    void testCheck(){
+        // Identical trees, then copies of them each differing in one way
+        auto writeTree = [](const std::string& root){
+            for(int file = 0; file < 20; file++){
+                writeFile(root, "dir" + std::to_string(file % 4) + "/file" + std::to_string(file), makeContent(20000, 100 + file));
+            }
+        };
+        for(auto root : {"check/A", "check/B", "check/older", "check/size", "check/content", "check/extra"}){
+            writeTree(root);
+        }
+        writeFile("check/older", "dir1/file5", makeContent(20000, 105), modified - 100);
+        writeFile("check/size", "dir2/file6", makeContent(20001, 106));
+        std::string content = makeContent(20000, 107);
+        content[10000] ^= 1;
+        writeFile("check/content", "dir3/file7", content);
+        writeFile("check/extra", "dir0/new", makeContent(10, 1));
+
+        std::string difference;
+        CHECK(checkBothWays("check/A", "check/B"));
+
+        // An older copy differs as much as a newer one, whichever tree is given first
+        CHECK(!checkBothWays("check/A", "check/older", &difference));
+        CHECK(difference == "size or modification time differs: dir1/file5");
+
+        CHECK(!checkBothWays("check/A", "check/content", &difference));
+        CHECK(difference == "contents differ: dir3/file7");
+
+        CHECK(!checkBothWays("check/A", "check/extra", &difference));
+        CHECK(difference.find("only in") == 0 && difference.find("dir0/new") != std::string::npos);
+
+        // Metadata proves the difference during the walks, so no file is read, and the worker checks again from scratch
+        Worker work(CreateChecksum("md5"));
+        CHECK(!work.Check(rootOf("check/A"), rootOf("check/size")));
+        CHECK(work.Difference() == "size or modification time differs: dir2/file6");
+        CHECK(work.Stats().FilesHashed == 0 && work.Stats().PrefilterPairs == 0);
+
+        CHECK(work.Check(rootOf("check/A"), rootOf("check/B")));
+        CHECK(work.Difference().empty());
+        CHECK(work.Stats().PrefilterPairs == 20);
+    }
+
+    // Runs a reconcile through the embedding API, one line per result: the replica, the root the change applies to,
+    // the operation, the path and, for a move, where the content was found
+    std::vector<std::string> visit(Reconciler& reconciler, const ReconcileOptions& options){
+        std::vector<std::string> lines;
+        auto visitor = MakeVisitor([&](const ReconcileEntry& entry){
+            std::string line = std::to_string(entry.Replica) + " " + std::to_string(entry.Root) + " "
+                + (char)entry.Operation + " " + std::string(entry.Path);
+            if(!entry.MovedFrom.empty()){
+                line += " <- " + std::string(entry.MovedFrom);
+            }
+            lines.push_back(line);
+        });
+        reconciler.Run(options, visitor);
+        return lines;
+    }
+
+    void testNWayMerge(){
+        for(auto root : {"nway/A", "nway/B", "nway/C"}){
+            writeFile(root, "common", makeContent(1000, 10));
+            writeFile(root, "changed", makeContent(1000, 11));
+        }
+        writeFile("nway/B", "changed", makeContent(1000, 12));
+        writeFile("nway/A", "onlyA", makeContent(10, 13));
+        writeFile("nway/B", "onlyB", makeContent(10, 14));
+        writeFile("nway/C", "onlyC", makeContent(10, 15));
+
+        Reconciler reconciler;
+        ReconcileOptions options;
+        options.Directories = {rootOf("nway/A"), rootOf("nway/B"), rootOf("nway/C")};
+
+        // Results of every replica against the primary, path after path out of a single merge
+        std::vector<std::string> lines = visit(reconciler, options);
+        CHECK(lines == std::vector<std::string>({
+            "1 0 ! changed", "1 1 ! changed", "2 0 = changed", "2 2 = changed",
+            "1 0 = common", "1 1 = common", "2 0 = common", "2 2 = common",
+            "1 1 + onlyA", "2 2 + onlyA",
+            "1 0 + onlyB",
+            "2 0 + onlyC"
+        }));
+
+        // The same as reconciling every replica on its own
+        for(size_t replica = 1; replica <= 2; replica++){
+            ReconcileOptions pair = options;
+            pair.Directories = {options.Directories[0], options.Directories[replica]};
+
+            std::vector<std::string> expected;
+            for(auto& line : visit(reconciler, pair)){
+                std::string root = line[2] == '0' ? "0" : std::to_string(replica);
+                expected.push_back(std::to_string(replica) + " " + root + line.substr(3));
+            }
+
+            std::vector<std::string> merged;
+            for(auto& line : lines){
+                if(line[0] == '0' + (char)replica){
+                    merged.push_back(line);
+                }
+            }
+            CHECK(merged == expected);
+        }
+
+        options.IgnoreUnchanged = true;
+        CHECK(visit(reconciler, options).size() == 6);
+    }
+
+    void testMoves(){
+        // A renamed file, one-sided files of the same size but other contents, and an unchanged one
+        std::string renamed = makeContent(5000, 20);
+        writeFile("moves/A", "old/name", renamed);
+        writeFile("moves/B", "new/name", renamed);
+        writeFile("moves/A", "decoy", makeContent(5000, 21));
+        writeFile("moves/B", "other", makeContent(5000, 22));
+        writeFile("moves/A", "kept", makeContent(10, 23));
+        writeFile("moves/B", "kept", makeContent(10, 23));
+
+        Reconciler reconciler;
+        ReconcileOptions options;
+        options.Directories = {rootOf("moves/A"), rootOf("moves/B")};
+        options.DetectMoves = true;
+        std::vector<std::string> expected = {
+            "1 0 > new/name <- old/name",
+            "1 0 = kept",
+            "1 0 + other",
+            "1 1 > old/name <- new/name",
+            "1 1 = kept",
+            "1 1 + decoy"
+        };
+        CHECK(visit(reconciler, options) == expected);
+
+        // Deferred digests are computed for the move candidates alone, for the same moves
+        options.Pipeline.PrefilterBytes = 4096;
+        CHECK(visit(reconciler, options) == expected);
+
+        // Without detection, both paths stay one-sided
+        options.DetectMoves = false;
+        std::vector<std::string> lines = visit(reconciler, options);
+        CHECK(std::count(lines.begin(), lines.end(), "1 0 + new/name") == 1);
+        CHECK(std::count(lines.begin(), lines.end(), "1 1 + old/name") == 1);
+    }
+
+    // A patch without its first line, the time it was written at
+    std::string patchBody(const std::string& path){
+        std::ifstream input(path);
+        std::string header;
+        std::getline(input, header);
+        return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+
+    void testStreamedPatches(const std::string& self){
+        // Enough top-level directories for every shard to get some, all files modified at the same time
+        for(int file = 0; file < 300; file++){
+            std::string path = "top" + std::to_string(file % 7) + "/sub" + std::to_string(file % 3) + "/file" + std::to_string(file);
+            std::string content = makeContent(100 + file, 200 + file);
+            if(file % 10 != 1){
+                writeFile("streamed/A", path, content);
+            }
+            if(file % 10 == 2){
+                content[0] ^= 1;
+            }
+            if(file % 10 != 3){
+                writeFile("streamed/B", path, content);
+            }
+        }
+        const std::string dirA = rootOf("streamed/A"), dirB = rootOf("streamed/B");
+        const std::string patch = (fs::path(treeDirectory) / "streamed.patch").string();
+        const std::string temporary = (fs::path(treeDirectory) / "temporary").string();
+        fs::create_directories(temporary);
+
+        for(bool ignoreUnchanged : {false, true}){
+            Worker memory(CreateChecksum("md5"));
+            std::vector<std::future<scan_result>> scans;
+            scans.push_back(memory.scanDirectory(dirA));
+            scans.push_back(memory.scanDirectory(dirB));
+            std::vector<scan_result> results = {scans[0].get(), scans[1].get()};
+            memory.Reconcile({dirA, dirB}, results, true);
+            memory.WriteResult({dirA, dirB}, patch, ignoreUnchanged);
+            std::string expected = patchBody(patch);
+            CHECK(expected.find("! top2/sub2/file2 ") != std::string::npos);
+
+            // Sorted runs of a few entries each, merged back into the same patch
+            WorkerOptions options;
+            options.MemoryBudget = 16 * 1024;
+            options.TempDirectory = temporary;
+            Worker external(CreateChecksum("md5"), options);
+            external.ReconcileExternal(dirA, dirB, patch, ignoreUnchanged);
+            CHECK(patchBody(patch) == expected);
+            CHECK(external.Stats().RunsWritten > 2);
+
+            // Worker processes, this test started again, by top-level entry and by path
+            for(auto forwarded : {std::vector<std::string>(), std::vector<std::string>({"--shard-by=hash"})}){
+                ShardCoordinator coordinator(self, "", forwarded, 3);
+                coordinator.Reconcile(dirA, dirB, patch, ignoreUnchanged, temporary);
+                CHECK(patchBody(patch) == expected);
+            }
+        }
+
+        // Every run and spilled stream was removed
+        CHECK(fs::is_empty(temporary));
+    }
+}
+
+int main(int argc, char** argv){
+    // Started by the shard coordinator as the worker of a shard, the records go to stdout as the program sends them
+    if(argc > 1 && std::string(argv[1]).compare(0, 15, "--shard-worker=") == 0){
+        ArgumentHolder args;
+        if(!args.Parse(argc, argv)){
+            return 2;
+        }
+
+        Worker work(args.Checksum, args.Options);
+        work.ScanShard(args.DirectoryA.string(), args.ShardIndex, args.ShardCount, stdout);
+        return 0;
+    }
+
+    fs::remove_all(treeDirectory);
+
+    testDeferredHashing();
+    testInodeDedupe();
+    testCheck();
+    testNWayMerge();
+    testMoves();
+    testStreamedPatches(fs::canonical(fs::read_symlink("/proc/self/exe")).string());
+
+    fs::remove_all(treeDirectory);
+    return CheckResult("reconcile_test");
+}
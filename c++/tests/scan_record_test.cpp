@@ -0,0 +1,118 @@
+// Scan records written with WriteRecord and read back by RecordReader and MergedRecords
+//
+// Build and run from the c++ directory:
+//   clang++ -std=c++17 tests/scan_record_test.cpp scan_record.cpp file_result.cpp -I. -o scan_record_test.out
+//   ./scan_record_test.out
+
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "scan_record.hpp"
+#include "check.hpp"
+
+namespace{
+    bool sameRecord(const FileResult& a, const FileResult& b){
+        return a.filepath == b.filepath && a.hash == b.hash && a.size == b.size && a.timeModified == b.timeModified;
+    }
+
+    // Writes the records to a new temporary stream, rewound for reading
+    std::FILE* writeRecords(const std::vector<FileResult>& records){
+        std::FILE* stream = std::tmpfile();
+        for(auto& record : records){
+            CHECK(WriteRecord(stream, record));
+        }
+        std::rewind(stream);
+        return stream;
+    }
+
+    // Reads every record of a source
+    std::vector<FileResult> readAll(RecordSource& source){
+        std::vector<FileResult> records;
+        FileResult record;
+        while(source.Next(record)){
+            records.push_back(record);
+        }
+        return records;
+    }
+
+    void testRoundTrip(){
+        std::vector<FileResult> records = {
+            FileResult("a", "D41D8CD98F00B204E9800998ECF8427E", 0, 0),
+            FileResult("dir/with space/and\nnewline", "", 1, 1500000000),
+            FileResult("\xC3\xA9t\xC3\xA9/big.bin", "ABCDEF", 6000000000L, -1),
+            FileResult(std::string(5000, 'p'), std::string(64, 'F'), 12345, 4102444800L)
+        };
+
+        std::FILE* stream = writeRecords(records);
+        RecordReader reader(stream, true);
+        std::vector<FileResult> read = readAll(reader);
+
+        CHECK(read.size() == records.size());
+        for(size_t i = 0; i < read.size() && i < records.size(); i++){
+            CHECK(sameRecord(read[i], records[i]));
+        }
+
+        // Exhausted sources stay exhausted
+        FileResult record;
+        CHECK(!reader.Next(record));
+    }
+
+    void testEmptyAndTruncated(){
+        RecordReader empty(writeRecords({}), true);
+        FileResult record;
+        CHECK(!empty.Next(record));
+
+        // A record cut after its path is an error, not the end of the stream
+        std::FILE* stream = writeRecords({FileResult("first", "00", 1, 1), FileResult("second", "11", 2, 2)});
+        std::fseek(stream, 0, SEEK_END);
+        long length = std::ftell(stream);
+        std::vector<char> bytes(length - 10);
+        std::rewind(stream);
+        CHECK(std::fread(bytes.data(), 1, bytes.size(), stream) == bytes.size());
+        std::fclose(stream);
+
+        std::FILE* truncated = std::tmpfile();
+        std::fwrite(bytes.data(), 1, bytes.size(), truncated);
+        std::rewind(truncated);
+
+        RecordReader reader(truncated, true);
+        CHECK(reader.Next(record) && record.filepath == "first");
+        bool threw = false;
+        try{
+            reader.Next(record);
+        }
+        catch(const std::runtime_error&){
+            threw = true;
+        }
+        CHECK(threw);
+    }
+
+    void testMerge(){
+        std::vector<std::unique_ptr<RecordSource>> sources;
+        sources.emplace_back(new RecordReader(writeRecords({FileResult("a", "1", 1, 1), FileResult("c/x", "3", 3, 3)}), true));
+        sources.emplace_back(new RecordReader(writeRecords({}), true));
+        sources.emplace_back(new RecordReader(writeRecords({FileResult("b", "2", 2, 2), FileResult("c", "4", 4, 4),
+            FileResult("d", "5", 5, 5)}), true));
+
+        MergedRecords merged(std::move(sources));
+        std::vector<FileResult> read = readAll(merged);
+
+        std::vector<std::string> expected = {"a", "b", "c", "c/x", "d"};
+        CHECK(read.size() == expected.size());
+        for(size_t i = 0; i < read.size() && i < expected.size(); i++){
+            CHECK(read[i].filepath == expected[i]);
+        }
+        CHECK(read.size() == 5 && read[3].hash == "3" && read[3].size == 3);
+    }
+}
+
+int main(){
+    testRoundTrip();
+    testEmptyAndTruncated();
+    testMerge();
+
+    return CheckResult("scan_record_test");
+}
@@ -0,0 +1,60 @@
+#include <algorithm>
+
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(unsigned int threadCount) : stopping(false){
+    threadCount = std::max(threadCount, 1u);
+    for(unsigned int i = 0; i < threadCount; i++){
+        this->threads.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> guard(this->tasksLock);
+        this->stopping = true;
+    }
+    this->tasksAvailable.notify_all();
+
+    for(auto& thread : this->threads){
+        thread.join();
+    }
+}
+
+void ThreadPool::run(){
+    while(true){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(this->tasksLock);
+            this->tasksAvailable.wait(guard, [this]{ return this->stopping || !this->tasks.empty(); });
+            if(this->tasks.empty()){
+                return;
+            }
+
+            task = std::move(this->tasks.front());
+            this->tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+// Queue a task for execution
+void ThreadPool::Post(std::function<void()> task){
+    {
+        std::lock_guard<std::mutex> guard(this->tasksLock);
+        this->tasks.push_back(std::move(task));
+    }
+    this->tasksAvailable.notify_one();
+}
+
+// Number of threads in the pool
+unsigned int ThreadPool::Size() const{
+    return this->threads.size();
+}
+
+// Number of tasks waiting for a thread
+size_t ThreadPool::Pending(){
+    std::lock_guard<std::mutex> guard(this->tasksLock);
+    return this->tasks.size();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads running posted tasks in FIFO order
+class ThreadPool{
+private:
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex tasksLock;
+    std::condition_variable tasksAvailable;
+    bool stopping;
+
+    // Body of every pool thread
+    void run();
+
+public:
+    // ctor w/ the number of threads to start
+    explicit ThreadPool(unsigned int threadCount);
+
+    // Finishes the queued tasks and joins the threads
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queue a task for execution
+    void Post(std::function<void()> task);
+
+    // Number of threads in the pool
+    unsigned int Size() const;
+
+    // Number of tasks waiting for a thread
+    size_t Pending();
+};
@@ -1,231 +1,1254 @@
 #define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
 
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
 #include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <queue>
 #include <unordered_map>
 #include <unordered_set>
 
+#include <sys/stat.h>
+
 #include <boost/filesystem.hpp>
-#include <cryptopp/filters.h>
-#include <cryptopp/files.h>
-#include <cryptopp/hex.h>
 
 #include "utils.hpp"
 #include "worker.hpp"
+#include "hash_scheduler.hpp"
+#include "move_join.hpp"
+#include "scan_record.hpp"
+#include "external_reconcile.hpp"
+#include "shard_coordinator.hpp"
+#include "path_sort.hpp"
+#include "alloc_tracking.hpp"
+#include "compressed_output.hpp"
 
 namespace fs = boost::filesystem;
 
-// for ease, we'll implement some set operators
-inline string_set operator-(const string_set& lhs, const string_set& rhs){
-    string_set difference;
-    for(auto& entry : lhs){
-        if(rhs.find(entry) == rhs.end()){
-            // If a suspected conflict is not in unchanged entry, it must be a real conflict
-            difference.insert(entry);
-        }
+namespace{
+    // Sort key of scanned entries
+    const std::string& filepathOf(const FileResultPtr& entry){
+        return entry->filepath;
     }
+}
 
-    return difference;
+Worker::Worker(const checksum_ptr instance, const WorkerOptions& options, std::shared_ptr<ThreadPool> pool)
+: checksumInstance(instance), options(options), metrics(options.DeferHashing()),
+  hashPool(pool ? pool : std::make_shared<ThreadPool>(options.AutoTune ? options.TuneMaxThreads : options.HashThreads)),
+  tuner(options.AutoTune
+    ? new ConcurrencyController(std::chrono::milliseconds(options.TuneWindowMilliseconds), this->hashPool->Size())
+    : nullptr),
+  reader(options.CachePolicy, options.DirectThreshold, &cancelled), cancelled(false) {}
+
+const WorkerStats& Worker::Stats() const{
+    return this->stats;
 }
 
-inline string_set operator&(const string_set& lhs, const string_set& rhs){
-    string_set intersection;
-    for(auto& entry : lhs){
-        if(rhs.find(entry) != rhs.end()){
-            // If a suspected conflict is not in unchanged entry, it must be a real conflict
-            intersection.insert(entry);
-        }
+std::string Worker::RenderMetrics(){
+    return this->metrics.Render(this->hashPool->Pending());
+}
+
+void Worker::PrintTimings(std::ostream& out){
+    this->metrics.PrintTimings(out);
+}
+
+void Worker::PrintTuning(std::ostream& out){
+    if(this->tuner){
+        this->tuner->Print(out);
     }
-    
-    return intersection;
 }
 
-Worker::Worker(const checksum_ptr instance) : checksumInstance(instance) {}
+ConcurrencyKnob* Worker::hashKnob(const std::string& root){
+    if(!this->tuner){
+        return nullptr;
+    }
+
+    // Tuning starts from the fixed setting
+    return this->tuner->Register("hash '" + root + "'", this->options.HashThreads);
+}
 
-void Worker::populateSetWithKeys(std::unordered_set<std::string>& set, scan_result& result){
-    for(auto& entry : result){
-        set.insert(entry.second->filepath);
+std::string Worker::hashFile(std::string filepath, chunk_list* chunks){
+    struct stat info;
+    if(!this->options.DedupeInodes || stat(filepath.c_str(), &info) != 0 || info.st_nlink < 2){
+        return this->computeDigest(filepath, chunks);
     }
+
+    bool computed = false;
+    std::string digest = this->inodeDigests.Get(
+        FileKey{(unsigned long long)info.st_dev, (unsigned long long)info.st_ino},
+        [this, &filepath, chunks]{
+            // A cancelled read stops early, its digest is only a partial one and must not be shared
+            std::string digest = this->computeDigest(filepath, chunks);
+            return this->cancelled ? std::string() : digest;
+        },
+        computed);
+
+    if(!computed){
+        this->stats.FilesDeduplicated++;
+        this->stats.BytesDeduplicated += info.st_size;
+    }
+
+    return digest;
 }
 
-std::string Worker::hashFile(std::string filepath){
+std::string Worker::computeDigest(const std::string& filepath, chunk_list* chunks){
     using namespace CryptoPP;
+    AllocScope tracking(AllocStructure::HASH_STATE);
 
     CryptoPP::HashTransformation* checksum = (CryptoPP::HashTransformation*)this->checksumInstance->Clone();
-    std::string digest;
-    FileSource fileSource(filepath.c_str(), true, new HashFilter(*checksum, new HexEncoder(new StringSink(digest))));
+    auto started = std::chrono::steady_clock::now();
+
+    // Chunking rides along the same read as the digest
+    std::unique_ptr<ContentChunker> chunker(chunks ? new ContentChunker() : nullptr);
+    unsigned long long bytesRead = this->reader.Read(filepath,
+        [checksum, &chunker](const unsigned char* data, size_t length){
+            checksum->Update(data, length);
+            if(chunker){
+                chunker->Update(data, length);
+            }
+        });
+
+    if(chunker){
+        *chunks = chunker->Finish();
+    }
+
+    std::vector<byte> raw(checksum->DigestSize());
+    checksum->Final(raw.data());
     delete checksum;
 
+    // Upper case hex, as HexEncoder writes it, without a filter chain per file
+    static const char hexDigits[] = "0123456789ABCDEF";
+    std::string digest(2 * raw.size(), '0');
+    for(size_t i = 0; i < raw.size(); i++){
+        digest[2 * i] = hexDigits[raw[i] >> 4];
+        digest[2 * i + 1] = hexDigits[raw[i] & 0x0F];
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    this->stats.HashNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    this->stats.BytesHashed += bytesRead;
+    this->stats.FilesHashed++;
+    this->metrics.BytesHashed.Add(bytesRead);
+    this->metrics.FilesHashed.Add(1);
+
+    if(this->options.ReportPageCache){
+        this->stats.PageCacheBytes += FileReader::ResidentBytes(filepath);
+        this->stats.PageCacheFiles++;
+    }
+
     return digest;
 }
 
-// Internal implementation of Scan Directory
-scan_result Worker::scanDirectoryInternal(std::string path){
+// Reads a given file only to cut it into content-defined chunks, without hashing it
+chunk_list Worker::chunkFile(const std::string& filepath){
+    ContentChunker chunker;
+    this->reader.Read(filepath, [&chunker](const unsigned char* data, size_t length){
+        chunker.Update(data, length);
+    });
+
+    this->stats.DeltaFilesRead++;
+    return chunker.Finish();
+}
+
+bool Worker::samplesMatch(std::string filepathA, std::string filepathB, long size, long sampleBytes){
+    std::ifstream fileA(filepathA, std::ifstream::binary), fileB(filepathB, std::ifstream::binary);
+    if(!fileA || !fileB){
+        // Let the full hash report the problem
+        return true;
+    }
+
+    long sampleSize = std::min(sampleBytes, size);
+    std::vector<char> bufferA(sampleSize), bufferB(sampleSize);
+    unsigned long long bytesRead = 0;
+
+    auto compareAt = [&](long offset, long length) -> bool {
+        fileA.seekg(offset);
+        fileB.seekg(offset);
+        fileA.read(bufferA.data(), length);
+        fileB.read(bufferB.data(), length);
+        bytesRead += fileA.gcount() + fileB.gcount();
+
+        return fileA.gcount() == fileB.gcount()
+            && std::equal(bufferA.begin(), bufferA.begin() + fileA.gcount(), bufferB.begin());
+    };
+
+    // The tail sample never overlaps the head, so small files are compared exactly once
+    long tailSize = std::min(sampleSize, size - sampleSize);
+    bool matches = compareAt(0, sampleSize) && (tailSize <= 0 || compareAt(size - tailSize, tailSize));
+
+    this->stats.PrefilterPairs++;
+    this->stats.PrefilterBytesRead += bytesRead;
+    if(!matches){
+        this->stats.PrefilterConflicts++;
+        this->stats.PrefilterBytesAvoided += 2 * size - bytesRead;
+    }
+
+    return matches;
+}
+
+bool Worker::sameInode(const std::string& filepathA, const std::string& filepathB){
+    struct stat infoA, infoB;
+    return stat(filepathA.c_str(), &infoA) == 0 && stat(filepathB.c_str(), &infoB) == 0
+        && infoA.st_dev == infoB.st_dev && infoA.st_ino == infoB.st_ino;
+}
+
+// Walks a directory tree, handing every file the include/exclude patterns and the filter keep to visit
+void Worker::walkDirectory(std::string path, const file_visitor& visit, const entry_filter& filter){
     // source: https://stackoverflow.com/questions/18233640/boostfilesystemrecursive-directory-iterator-with-filter
 
     // Paths comes in as "/a", so the cut index accounts for the leftmost separator removal with +1
     int cutIndex = path.length() + 1;
-    scan_result retVal;
     fs::recursive_directory_iterator end, dirWalker(path);
+
+    // Counted down however the walk ends
+    struct ActiveWalk{
+        std::atomic<int>& walks;
+        ~ActiveWalk(){ this->walks--; }
+    } active{this->metrics.WalksActive};
+    this->metrics.WalksActive++;
     
-    while(dirWalker != end){
+    while(dirWalker != end && !this->cancelled){
         auto filepathInfo = dirWalker->path();
         auto filepath = filepathInfo.string();
 
-        if(! fs::is_directory(filepathInfo)){
-            // Build a new result with a path that does NOT include the original path being scanned
-            std::string shortenedPath = filepath.substr(cutIndex, filepath.length() - cutIndex);
-            auto result = std::shared_ptr<FileResult>(
-                new FileResult(
-                    shortenedPath,
-                    this->hashFile(filepath),
-                    fs::file_size(filepathInfo),
-                    fs::last_write_time(filepathInfo)
-                ));
-            
-            retVal[shortenedPath] = result;
+        // The entry caches the type read along with the directory, so this only stats symlinks
+        bool isDirectory = fs::is_directory(dirWalker->status());
+
+        // Build a new result with a path that does NOT include the original path being scanned
+        std::string shortenedPath = filepath.substr(cutIndex, filepath.length() - cutIndex);
+
+        if(!this->options.Filter.Empty() && !this->options.Filter.Keeps(shortenedPath, isDirectory)){
+            // Excluded entries are dropped before their size or time is read, excluded directories are never opened
+            this->stats.EntriesPruned++;
+            if(isDirectory){
+                dirWalker.no_push();
+            }
+        }
+        else if(filter && !filter(shortenedPath, isDirectory)){
+            // Rejected directories are not descended into
+            if(isDirectory){
+                dirWalker.no_push();
+            }
+        }
+        else if(!isDirectory){
+            FileResultPtr result;
+            {
+                AllocScope tracking(AllocStructure::FILE_RESULTS);
+                result = std::shared_ptr<FileResult>(
+                    new FileResult(
+                        shortenedPath,
+                        std::string(),
+                        fs::file_size(filepathInfo),
+                        fs::last_write_time(filepathInfo)
+                    ));
+            }
+
+            this->metrics.FilesDiscovered.Add(1);
+            this->metrics.BytesDiscovered.Add(result->size);
+            visit(filepath, result);
         }
         
         ++dirWalker;
     }
-
-    return retVal;
 }
 
-// Actually creates the patch data
-std::shared_ptr<patch_result> Worker::createPatchData(
-    scan_result& src, string_set& pathsSrc,
-    scan_result& target, string_set& pathsTarget,
-    string_set& unchanged, string_set& conflicts){
-    
-    std::shared_ptr<patch_result> retVal = std::shared_ptr<patch_result>(new patch_result());
-    patch_result &resultMap = *retVal;
-    
-    string_set additions = pathsSrc - pathsTarget;
-    
-    resultMap[ReconcileOperation::ADD].reserve(additions.size());
-    for(const auto& addition : additions){
-        resultMap[ReconcileOperation::ADD].push_back(src[addition]);
+// Scans one shard of a directory and writes its sorted records to a stream
+void Worker::ScanShard(std::string path, size_t index, size_t count, std::FILE* output){
+    this->metrics.Enter(PipelinePhase::SCAN);
+    std::vector<FileResultPtr> entries;
+    HashScheduler scheduler(
+        *this->hashPool,
+        [this](const std::string& filepath){ return this->hashFile(filepath); },
+        this->options.ReadOrder, this->options.BatchWindow, this->stats, this->hashKnob(path));
+
+    ShardMode mode = this->options.ShardBy;
+    this->walkDirectory(path,
+        [&](const std::string& filepath, FileResultPtr result){
+            {
+                AllocScope tracking(AllocStructure::RECORDS);
+                entries.push_back(result);
+            }
+            scheduler.Add(filepath, result);
+        },
+        [=](const std::string& relativePath, bool isDirectory){
+            bool topLevel = relativePath.find('/') == std::string::npos;
+
+            // Top-level sharding decides once per top-level entry, hash sharding once per file
+            if(mode == ShardMode::TOPLEVEL){
+                return !topLevel || ShardOf(relativePath, count) == index;
+            }
+            return isDirectory || ShardOf(relativePath, count) == index;
+        });
+
+    scheduler.Finish();
+    SortByPath(entries, filepathOf, this->hashPool.get());
+
+    for(auto& entry : entries){
+        if(!WriteRecord(output, *entry)){
+            throw std::runtime_error("Unable to write the records of shard " + std::to_string(index));
+        }
     }
 
-    resultMap[ReconcileOperation::UNCHANGED].reserve(unchanged.size());
-    for(const auto& entry : unchanged){
-        resultMap[ReconcileOperation::UNCHANGED].push_back(target[entry]);
+    std::fflush(output);
+}
+
+// Internal implementation of Scan Directory
+scan_result Worker::scanDirectoryInternal(std::string path){
+    this->metrics.Enter(PipelinePhase::SCAN);
+    scan_result retVal;
+
+    // The previous scan of this root, if it was persisted
+    ScanCache cache;
+    std::string algorithm = this->checksumInstance->AlgorithmName();
+    std::string cachePath = this->options.ScanCacheDirectory.empty()
+        ? std::string()
+        : ScanCache::PathFor(this->options.ScanCacheDirectory, path);
+    bool cached = !cachePath.empty() && cache.Load(cachePath, algorithm);
+    std::time_t scanned = std::time(nullptr);
+
+    // Digests are filled in by the hash stage while the walk goes on
+    HashScheduler scheduler(
+        *this->hashPool,
+        [this](const std::string& filepath){ return this->hashFile(filepath); },
+        this->options.ReadOrder, this->options.BatchWindow, this->stats, this->hashKnob(path));
+
+    this->walkDirectory(path, [&](const std::string& filepath, FileResultPtr result){
+        {
+            AllocScope tracking(AllocStructure::SCAN_INDEX);
+            retVal.push_back(result);
+        }
+
+        if(cached){
+            result->hash = cache.Digest(*result);
+        }
+
+        if(!result->hash.empty()){
+            // Settled without a read, which still counts as hashed for the progress of the pipeline
+            this->stats.FilesFromCache++;
+            this->stats.BytesFromCache += result->size;
+            this->metrics.FilesHashed.Add(1);
+            this->metrics.BytesHashed.Add(result->size);
+        }
+        else if(!this->options.DeferHashing()){
+            scheduler.Add(filepath, result);
+        }
+    });
+
+    scheduler.Finish();
+
+    // Sorted once here, for the directory digests and for every consumer of the scan
+    SortByPath(retVal, filepathOf, this->hashPool.get());
+
+    // Without any digest there is nothing for the directory digests to tell apart
+    if(this->options.DeferHashing() && cachePath.empty()){
+        return retVal;
     }
 
-    resultMap[ReconcileOperation::CONFLICT].reserve(conflicts.size());
-    for(const auto& entry : conflicts){
-        resultMap[ReconcileOperation::CONFLICT].push_back(target[entry]);
+    directory_digests digests = BuildDirectoryDigests(retVal);
+    if(!cachePath.empty() && !this->options.DeferHashing() && !this->cancelled){
+        this->saveScanCache(path, retVal, scanned);
     }
 
+    std::lock_guard<std::mutex> guard(this->digestsLock);
+    this->directoryDigests[path] = std::move(digests);
+    this->scanTimes[path] = scanned;
     return retVal;
 }
 
+// Persists the files of a root, whose walk started at scanned, to the scan cache
+void Worker::saveScanCache(const std::string& root, const scan_result& files, std::time_t scanned){
+    std::string cachePath = ScanCache::PathFor(this->options.ScanCacheDirectory, root);
+    if(!ScanCache::Save(cachePath, this->checksumInstance->AlgorithmName(), files, scanned)){
+        this->stats.ScanCacheFailures++;
+    }
+}
+
 // Asynchronously run scanDirectory
 std::future<scan_result> Worker::scanDirectory(std::string path){
+    // A check run before on this worker may have cancelled its walks
+    this->cancelled = false;
     return std::async(std::launch::async, &Worker::scanDirectoryInternal, this, path);
 }
 
-// Run the reconcile operation
-void Worker::Reconcile(scan_result& resultA, scan_result& resultB, bool keepResult){    
-    string_set pathsA, pathsB;
-    this->populateSetWithKeys(pathsA, resultA);
-    this->populateSetWithKeys(pathsB, resultB);
-    
-    string_set suspectedConflicts = pathsA & pathsB;
+void Worker::reportDifference(std::string description){
+    std::lock_guard<std::mutex> guard(this->differenceLock);
+    if(this->difference.empty()){
+        this->difference = description;
+    }
+
+    this->cancelled = true;
+}
+
+std::string Worker::Difference(){
+    std::lock_guard<std::mutex> guard(this->differenceLock);
+    return this->difference;
+}
+
+// Scans a directory into sorted run files of scan records
+std::vector<std::string> Worker::ScanToRuns(std::string path, long runBudget, std::string tempDir, TempFiles& temporaries){
+    this->metrics.Enter(PipelinePhase::SCAN);
+    std::vector<std::string> runs;
+    std::vector<FileResultPtr> run;
+    long runBytes = 0;
+
+    HashScheduler scheduler(
+        *this->hashPool,
+        [this](const std::string& filepath){ return this->hashFile(filepath); },
+        this->options.ReadOrder, this->options.BatchWindow, this->stats, this->hashKnob(path));
+
+    auto spill = [&](){
+        if(run.empty()){
+            return;
+        }
+
+        AllocScope tracking(AllocStructure::RECORDS);
+        // Digests of the run must be in before it is written
+        scheduler.Finish();
+        SortByPath(run, filepathOf, this->hashPool.get());
+
+        std::string runPath = temporaries.Create(tempDir, "scan-%%%%-%%%%-%%%%.run");
+        std::FILE* stream = std::fopen(runPath.c_str(), "wb");
+        if(!stream){
+            throw std::runtime_error("Unable to create run '" + runPath + "'");
+        }
+
+        bool written = true;
+        for(auto& entry : run){
+            written = written && WriteRecord(stream, *entry);
+        }
+        written = std::fclose(stream) == 0 && written;
+
+        runs.push_back(runPath);
+        if(!written){
+            throw std::runtime_error("Unable to write run '" + runPath + "'");
+        }
+
+        this->stats.RunsWritten++;
+        run.clear();
+        runBytes = 0;
+    };
+
+    this->walkDirectory(path, [&](const std::string& filepath, FileResultPtr result){
+        {
+            AllocScope tracking(AllocStructure::RECORDS);
+            run.push_back(result);
+        }
+        scheduler.Add(filepath, result);
+
+        // Entry, shared_ptr control block, path, digest and the run slot
+        runBytes += sizeof(FileResult) + 32 + result->filepath.capacity() + 2 * this->checksumInstance->DigestSize() + 16;
+        if(runBytes >= runBudget){
+            spill();
+        }
+    });
+
+    spill();
+    return runs;
+}
+
+// Tells whether both trees hold the same files, stopping at the first proven difference
+bool Worker::Check(std::string dirA, std::string dirB){
+    this->metrics.Enter(PipelinePhase::SCAN);
+    typedef std::pair<FileResultPtr, FileResultPtr> file_pair;
+
+    // A previous check may have stopped at its first difference, this one starts over
+    this->cancelled = false;
+    {
+        std::lock_guard<std::mutex> guard(this->differenceLock);
+        this->difference.clear();
+    }
+    const std::string roots[2] = {dirA, dirB};
+
+    // Files seen on one side only so far, paired up as soon as the other side finds them
+    std::mutex pairingLock;
+    std::unordered_map<std::string, FileResultPtr> unpaired[2];
+    bool walked[2] = {false, false};
+    std::vector<file_pair> pairs;
 
-    string_set unchangedPaths;
-    for(auto& entry : suspectedConflicts){
-        string_set::iterator entryA = pathsA.find(entry), entryB = pathsB.find(entry);
-        if(entryA == pathsA.end() || entryB == pathsB.end()){
+    auto offer = [&](int side, FileResultPtr result){
+        std::lock_guard<std::mutex> guard(pairingLock);
+        auto& others = unpaired[1 - side];
+        auto match = others.find(result->filepath);
+
+        if(match == others.end()){
+            if(walked[1 - side]){
+                this->reportDifference("only in '" + roots[side] + "': " + result->filepath);
+            }
+            else{
+                unpaired[side].emplace(result->filepath, result);
+            }
+            return;
+        }
+
+        file_pair pair = side == 0 ? file_pair(result, match->second) : file_pair(match->second, result);
+        others.erase(match);
+
+        // Metadata is the cheapest evidence, content is only looked at once both walks are done
+        if(!pair.first->metadataMatches(*pair.second)){
+            this->reportDifference("size or modification time differs: " + result->filepath);
+        }
+        else{
+            pairs.push_back(pair);
+        }
+    };
+
+    auto walk = [&](int side){
+        try{
+            this->walkDirectory(roots[side], [&](const std::string&, FileResultPtr result){ offer(side, result); });
+        }
+        catch(...){
+            // A tree that can't be walked can't be told identical or not, the other walk stops too
+            this->cancelled = true;
+            throw;
+        }
+
+        std::lock_guard<std::mutex> guard(pairingLock);
+        walked[side] = true;
+        if(!unpaired[1 - side].empty()){
+            this->reportDifference("only in '" + roots[1 - side] + "': " + unpaired[1 - side].begin()->second->filepath);
+        }
+    };
+
+    auto walkA = std::async(std::launch::async, walk, 0);
+    auto walkB = std::async(std::launch::async, walk, 1);
+    walkA.get();
+    walkB.get();
+
+    // Compare contents on the hash pool, samples first, then full digests
+    long sampleBytes = this->options.PrefilterBytes > 0 ? this->options.PrefilterBytes : 4096;
+    std::mutex remainingLock;
+    std::condition_variable remainingDone;
+    size_t remaining = pairs.size();
+    std::exception_ptr failure;
+
+    for(auto& pair : pairs){
+        this->hashPool->Post([&, pair]{
+            std::string filepathA = (fs::path(dirA) / pair.first->filepath).string();
+            std::string filepathB = (fs::path(dirB) / pair.second->filepath).string();
+
+            try{
+                if(!this->cancelled && !this->sameInode(filepathA, filepathB)){
+                    bool same = this->samplesMatch(filepathA, filepathB, pair.first->size, sampleBytes)
+                        && this->hashFile(filepathA) == this->hashFile(filepathB);
+
+                    // A cancelled read leaves a partial digest, which proves nothing
+                    if(!same && !this->cancelled){
+                        this->reportDifference("contents differ: " + pair.first->filepath);
+                    }
+                }
+            }
+            catch(...){
+                // An unreadable file is an error, not a difference
+                std::lock_guard<std::mutex> guard(remainingLock);
+                if(!failure){
+                    failure = std::current_exception();
+                }
+                this->cancelled = true;
+            }
+
+            std::lock_guard<std::mutex> guard(remainingLock);
+            if(--remaining == 0){
+                remainingDone.notify_all();
+            }
+        });
+    }
+
+    std::unique_lock<std::mutex> guard(remainingLock);
+    remainingDone.wait(guard, [&]{ return remaining == 0; });
+    if(failure){
+        std::rethrow_exception(failure);
+    }
+
+    return this->Difference().empty();
+}
+
+// Merge the primary root (first) against every replica, handing each result to the sink as it is produced
+void Worker::ReconcileTo(const std::vector<std::string>& dirs, std::vector<scan_result>& results, const reconcile_sink& sink){
+    this->metrics.Enter(PipelinePhase::RECONCILE);
+    size_t rootCount = results.size();
+
+    // A check run before on this worker may have cancelled its outstanding work
+    this->cancelled = false;
+    this->conflictChunks.clear();
+
+    // Scans come out sorted, anything else handed in is sorted here
+    for(auto& result : results){
+        if(!std::is_sorted(result.begin(), result.end(), [](const FileResultPtr& a, const FileResultPtr& b){ return a->filepath < b->filepath; })){
+            SortByPath(result, filepathOf, this->hashPool.get());
+        }
+    }
+
+    // k-way merge: the heap holds every root with entries left, the one with the smallest next path on top
+    std::vector<size_t> positions(rootCount, 0);
+    auto headPath = [&](size_t root) -> const std::string& { return results[root][positions[root]]->filepath; };
+    auto later = [&](size_t a, size_t b){
+        const std::string& pathA = headPath(a);
+        const std::string& pathB = headPath(b);
+        return pathA > pathB || (pathA == pathB && a > b);
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heads(later);
+
+    for(size_t root = 0; root < rootCount; root++){
+        if(!results[root].empty()){
+            heads.push(root);
+        }
+    }
+
+    // Directory digests of every root when all of them have some matching their scan
+    std::vector<const directory_digests*> digests;
+    {
+        std::lock_guard<std::mutex> guard(this->digestsLock);
+        for(size_t root = 0; root < rootCount; root++){
+            auto found = this->directoryDigests.find(dirs[root]);
+            auto top = found == this->directoryDigests.end() ? nullptr : &found->second;
+            if(!top || top->find("") == top->end() || top->at("").files != results[root].size()){
+                digests.clear();
+                break;
+            }
+            digests.push_back(&found->second);
+        }
+    }
+
+    // Results reach the sink in merge order. Under deferred hashing a pair with the same metadata can only be
+    // told apart by content, it waits along with every result after it until its batch is settled on the hash pool
+    struct Outcome{
+        size_t root;
+        ReconcileOperation operation;
+        FileResultPtr primary;
+        FileResultPtr replica;
+    };
+    std::vector<Outcome> outcomes;
+    std::vector<size_t> unsettled;
+    size_t batch = this->options.BatchWindow > 0 ? (size_t)this->options.BatchWindow : outcomes.max_size();
+
+    auto emit = [&](const Outcome& outcome){
+        if(outcome.primary && outcome.replica){
+            sink(outcome.root, true, outcome.operation, outcome.primary);
+            sink(outcome.root, false, outcome.operation, outcome.replica);
+        }
+        else if(outcome.primary){
+            sink(outcome.root, false, outcome.operation, outcome.primary);
+        }
+        else{
+            sink(outcome.root, true, outcome.operation, outcome.replica);
+        }
+    };
+
+    auto settle = [&]{
+        // Head/tail samples of every pair first, a differing sample proves a conflict without a full read
+        std::vector<char> sampled(unsettled.size(), 1);
+        if(this->options.PrefilterBytes > 0){
+            std::mutex remainingLock;
+            std::condition_variable remainingDone;
+            size_t remaining = unsettled.size();
+            std::exception_ptr failure;
+
+            for(size_t pair = 0; pair < unsettled.size(); pair++){
+                this->hashPool->Post([&, pair]{
+                    try{
+                        Outcome& outcome = outcomes[unsettled[pair]];
+                        std::string filepathA = (fs::path(dirs[0]) / outcome.primary->filepath).string();
+                        std::string filepathB = (fs::path(dirs[outcome.root]) / outcome.replica->filepath).string();
+
+                        // Two links to the same inode can't differ, sampling them would only read the file twice
+                        if(!this->sameInode(filepathA, filepathB)){
+                            sampled[pair] = this->samplesMatch(filepathA, filepathB, outcome.primary->size, this->options.PrefilterBytes);
+                        }
+                    }
+                    catch(...){
+                        std::lock_guard<std::mutex> guard(remainingLock);
+                        failure = failure ? failure : std::current_exception();
+                    }
+
+                    std::lock_guard<std::mutex> guard(remainingLock);
+                    if(--remaining == 0){
+                        remainingDone.notify_all();
+                    }
+                });
+            }
+
+            std::unique_lock<std::mutex> guard(remainingLock);
+            remainingDone.wait(guard, [&]{ return remaining == 0; });
+            if(failure){
+                std::rethrow_exception(failure);
+            }
+        }
+
+        // Then the digests the remaining pairs lack, in device order and once per entry and per inode.
+        // For deltas the same read cuts the chunks, kept below for the pairs it proves in conflict
+        std::mutex chunksLock;
+        std::unordered_map<std::string, chunk_list> chunks;
+        {
+            HashScheduler scheduler(
+                *this->hashPool,
+                [this, &chunksLock, &chunks](const std::string& filepath){
+                    if(!this->options.ComputeDeltas){
+                        return this->hashFile(filepath);
+                    }
+
+                    chunk_list fileChunks;
+                    std::string digest = this->hashFile(filepath, &fileChunks);
+                    if(!fileChunks.empty()){
+                        std::lock_guard<std::mutex> guard(chunksLock);
+                        chunks[filepath] = std::move(fileChunks);
+                    }
+                    return digest;
+                },
+                this->options.ReadOrder, this->options.BatchWindow, this->stats);
+
+            std::unordered_set<const FileResult*> queued;
+            for(size_t pair = 0; pair < unsettled.size(); pair++){
+                Outcome& outcome = outcomes[unsettled[pair]];
+                if(!sampled[pair]){
+                    continue;
+                }
+
+                if(outcome.primary->hash.empty() && queued.insert(outcome.primary.get()).second){
+                    scheduler.Add((fs::path(dirs[0]) / outcome.primary->filepath).string(), outcome.primary);
+                }
+                if(outcome.replica->hash.empty() && queued.insert(outcome.replica.get()).second){
+                    scheduler.Add((fs::path(dirs[outcome.root]) / outcome.replica->filepath).string(), outcome.replica);
+                }
+            }
+
+            scheduler.Finish();
+        }
+
+        // A primary file in conflict with several replicas keeps the chunks of its first conflict
+        auto keepChunks = [&](const std::string& filepath){
+            auto found = chunks.find(filepath);
+            if(found != chunks.end()){
+                this->conflictChunks[filepath] = std::move(found->second);
+                chunks.erase(found);
+            }
+        };
+
+        for(size_t pair = 0; pair < unsettled.size(); pair++){
+            Outcome& outcome = outcomes[unsettled[pair]];
+            outcome.operation = sampled[pair] && *outcome.primary == *outcome.replica
+                ? ReconcileOperation::UNCHANGED
+                : ReconcileOperation::CONFLICT;
+
+            if(outcome.operation == ReconcileOperation::CONFLICT && !chunks.empty()){
+                keepChunks((fs::path(dirs[0]) / outcome.primary->filepath).string());
+                keepChunks((fs::path(dirs[outcome.root]) / outcome.replica->filepath).string());
+            }
+        }
+
+        for(auto& outcome : outcomes){
+            emit(outcome);
+        }
+        outcomes.clear();
+        unsettled.clear();
+    };
+
+    // Hands a result on, or queues it behind the pairs still waiting for their content
+    auto record = [&](size_t root, ReconcileOperation operation, const FileResultPtr& primary, const FileResultPtr& replica){
+        if(outcomes.empty()){
+            emit(Outcome{root, operation, primary, replica});
+        }
+        else{
+            outcomes.push_back(Outcome{root, operation, primary, replica});
+        }
+    };
+
+    std::vector<FileResultPtr> present(rootCount);
+    while(!heads.empty()){
+        const std::string path = headPath(heads.top());
+        std::fill(present.begin(), present.end(), nullptr);
+
+        // Every root positioned on the first file of a subtree identical in all of them: the whole subtree
+        // is unchanged, without a single comparison, and the merge resumes after it
+        bool everywhere = !digests.empty() && heads.size() == rootCount;
+        for(size_t root = 0; root < rootCount && everywhere; root++){
+            everywhere = headPath(root) == path;
+        }
+
+        size_t identical = everywhere ? this->identicalSubtree(path, digests) : 0;
+        if(identical > 0){
+            for(size_t file = 0; file < identical; file++){
+                for(size_t root = 1; root < rootCount; root++){
+                    record(root, ReconcileOperation::UNCHANGED,
+                        results[0][positions[0] + file], results[root][positions[root] + file]);
+                }
+            }
+
+            while(!heads.empty()){
+                heads.pop();
+            }
+            for(size_t root = 0; root < rootCount; root++){
+                positions[root] += identical;
+                if(positions[root] < results[root].size()){
+                    heads.push(root);
+                }
+            }
+
+            this->stats.SubtreesSkipped++;
+            this->stats.FilesSkipped += identical;
             continue;
         }
 
-        FileResult& entryInfoA = *resultA[*entryA];
-        FileResult& entryInfoB = *resultB[*entryB];
+        // Pop every root holding this path
+        while(!heads.empty() && headPath(heads.top()) == path){
+            size_t root = heads.top();
+            present[root] = results[root][positions[root]];
+            heads.pop();
 
-        if(entryInfoA == entryInfoB){
-            unchangedPaths.insert(entry);
+            if(++positions[root] < results[root].size()){
+                heads.push(root);
+            }
+        }
+
+        for(size_t root = 1; root < rootCount; root++){
+            if(present[0] && present[root]){
+                if(!this->options.DeferHashing()){
+                    record(root, *present[0] == *present[root] ? ReconcileOperation::UNCHANGED : ReconcileOperation::CONFLICT,
+                        present[0], present[root]);
+                }
+                else if(!present[0]->metadataMatches(*present[root])){
+                    // Differing metadata already makes this a conflict, no need to read anything
+                    record(root, ReconcileOperation::CONFLICT, present[0], present[root]);
+                }
+                else{
+                    unsettled.push_back(outcomes.size());
+                    outcomes.push_back(Outcome{root, ReconcileOperation::UNCHANGED, present[0], present[root]});
+                }
+            }
+            else if(present[0]){
+                record(root, ReconcileOperation::ADD, present[0], nullptr);
+            }
+            else if(present[root]){
+                record(root, ReconcileOperation::ADD, nullptr, present[root]);
+            }
+        }
+
+        if(unsettled.size() >= batch){
+            settle();
+        }
+    }
+
+    settle();
+
+    // Under deferred hashing the scans are only cached now, with the digests reconcile computed
+    if(this->options.DeferHashing() && !this->options.ScanCacheDirectory.empty() && !this->cancelled){
+        for(size_t root = 0; root < rootCount; root++){
+            std::time_t scanned;
+            {
+                std::lock_guard<std::mutex> guard(this->digestsLock);
+                auto found = this->scanTimes.find(dirs[root]);
+                if(found == this->scanTimes.end()){
+                    continue;
+                }
+                scanned = found->second;
+            }
+
+            this->saveScanCache(dirs[root], results[root], scanned);
         }
     }
+}
 
-    string_set conflicts = suspectedConflicts - unchangedPaths;
+// Files in the largest directory above path whose digest is the same in every root, 0 when there is none
+size_t Worker::identicalSubtree(const std::string& path, const std::vector<const directory_digests*>& digests){
+    // From the root down, the first identical directory is the largest one
+    for(size_t end = 0; end != std::string::npos; end = path.find('/', end + 1)){
+        std::string directory = path.substr(0, end);
 
-    std::shared_ptr<patch_result> patchA = 
-        this->createPatchData(
-            resultB, pathsB,
-            resultA, pathsA,
-            unchangedPaths, conflicts);
-    std::shared_ptr<patch_result> patchB =
-        this->createPatchData(
-            resultA, pathsA,
-            resultB, pathsB,
-            unchangedPaths, conflicts);
+        auto primary = digests[0]->find(directory);
+        bool identical = primary != digests[0]->end() && !primary->second.digest.empty();
+        for(size_t root = 1; root < digests.size() && identical; root++){
+            auto replica = digests[root]->find(directory);
+            identical = replica != digests[root]->end() && replica->second.digest == primary->second.digest;
+        }
+
+        if(identical){
+            return primary->second.files;
+        }
+    }
+
+    return 0;
+}
+
+// Run the reconcile operation of the primary root (first) against every replica
+void Worker::Reconcile(const std::vector<std::string>& dirs, std::vector<scan_result>& results, bool keepResult){
+    AllocScope tracking(AllocStructure::PATCH);
+
+    // One pair of patches per replica: changes for the primary, changes for the replica
+    std::vector<reconcile_result> reconciled;
+    for(size_t root = 1; root < results.size(); root++){
+        reconcile_result patches(patch_result_ptr(new patch_result()), patch_result_ptr(new patch_result()));
+        for(auto patch : {patches.first, patches.second}){
+            (*patch)[ReconcileOperation::ADD];
+            (*patch)[ReconcileOperation::UNCHANGED];
+            (*patch)[ReconcileOperation::CONFLICT];
+        }
+
+        reconciled.push_back(patches);
+    }
+
+    this->ReconcileTo(dirs, results,
+        [&reconciled](size_t replica, bool toPrimary, ReconcileOperation operation, const FileResultPtr& entry){
+            auto& patches = reconciled[replica - 1];
+            (*(toPrimary ? patches.first : patches.second))[operation].push_back(entry);
+        });
 
     if(keepResult){
-        this->lastReconcile = std::shared_ptr<reconcile_result>(new reconcile_result(patchA, patchB));
+        this->lastReconcile = reconciled;
+    }
+}
+
+// Hands every entry of the saved result to the sink
+void Worker::VisitResult(const reconcile_sink& sink){
+    for(size_t replica = 0; replica < this->lastReconcile.size(); replica++){
+        for(auto& operation_set : *this->lastReconcile[replica].first){
+            for(auto& entry : operation_set.second){
+                sink(replica + 1, true, operation_set.first, entry);
+            }
+        }
+        for(auto& operation_set : *this->lastReconcile[replica].second){
+            for(auto& entry : operation_set.second){
+                sink(replica + 1, false, operation_set.first, entry);
+            }
+        }
+    }
+}
+
+// Turns one-sided ADD entries whose content exists on the other side under another path into MOVE entries
+void Worker::DetectMoves(const std::vector<std::string>& dirs){
+    this->metrics.Enter(PipelinePhase::MOVES);
+    for(size_t replica = 0; replica < this->lastReconcile.size(); replica++){
+        // Files only the replica has, to be added to the primary, and the other way around
+        patch_result& patchPrimary = *this->lastReconcile[replica].first;
+        patch_result& patchReplica = *this->lastReconcile[replica].second;
+        auto& replicaOnly = patchPrimary[ReconcileOperation::ADD];
+        auto& primaryOnly = patchReplica[ReconcileOperation::ADD];
+
+        // Only sizes present on both sides can match, and empty files carry nothing worth moving
+        std::unordered_set<long> primarySizes;
+        for(auto& entry : primaryOnly){
+            primarySizes.insert(entry->size);
+        }
+
+        std::unordered_set<long> sharedSizes;
+        for(auto& entry : replicaOnly){
+            if(entry->size > 0 && primarySizes.count(entry->size) > 0){
+                sharedSizes.insert(entry->size);
+            }
+        }
+
+        std::vector<FileResultPtr> left, right;
+        std::vector<size_t> leftIndices, rightIndices;
+        auto collect = [&](std::vector<FileResultPtr>& entries, std::vector<FileResultPtr>& side, std::vector<size_t>& indices){
+            for(size_t i = 0; i < entries.size(); i++){
+                if(sharedSizes.count(entries[i]->size) > 0){
+                    side.push_back(entries[i]);
+                    indices.push_back(i);
+                }
+            }
+        };
+        collect(replicaOnly, left, leftIndices);
+        collect(primaryOnly, right, rightIndices);
+
+        // Deferred digests are computed now, for the candidates only
+        {
+            HashScheduler scheduler(
+                *this->hashPool,
+                [this](const std::string& filepath){ return this->hashFile(filepath); },
+                this->options.ReadOrder, this->options.BatchWindow, this->stats);
+
+            for(auto& entry : left){
+                if(entry->hash.empty()){
+                    scheduler.Add((fs::path(dirs[replica + 1]) / entry->filepath).string(), entry);
+                }
+            }
+            for(auto& entry : right){
+                if(entry->hash.empty()){
+                    scheduler.Add((fs::path(dirs[0]) / entry->filepath).string(), entry);
+                }
+            }
+
+            scheduler.Finish();
+        }
+
+        auto matches = JoinOnContent(left, right, *this->hashPool, this->options.MoveJoinMemory);
+        if(matches.empty()){
+            continue;
+        }
+
+        std::vector<bool> movedLeft(replicaOnly.size(), false), movedRight(primaryOnly.size(), false);
+        auto& movesPrimary = patchPrimary[ReconcileOperation::MOVE];
+        auto& movesReplica = patchReplica[ReconcileOperation::MOVE];
+
+        for(auto& match : matches){
+            movedLeft[leftIndices[match.first]] = true;
+            movedRight[rightIndices[match.second]] = true;
+
+            // Each side gets the other side's path, and the local path holding the same content
+            FileResultPtr movePrimary(new FileResult(*left[match.first]));
+            movePrimary->movedFrom = right[match.second]->filepath;
+            movesPrimary.push_back(movePrimary);
+
+            FileResultPtr moveReplica(new FileResult(*right[match.second]));
+            moveReplica->movedFrom = left[match.first]->filepath;
+            movesReplica.push_back(moveReplica);
+
+            this->stats.MovesDetected++;
+            this->stats.MoveBytes += left[match.first]->size;
+        }
+
+        auto removeMoved = [](std::vector<FileResultPtr>& entries, const std::vector<bool>& moved){
+            size_t kept = 0;
+            for(size_t i = 0; i < entries.size(); i++){
+                if(!moved[i]){
+                    entries[kept++] = entries[i];
+                }
+            }
+            entries.resize(kept);
+        };
+        removeMoved(replicaOnly, movedLeft);
+        removeMoved(primaryOnly, movedRight);
+    }
+}
+
+// Describes every saved CONFLICT in matched and changed byte ranges of the replica copy against the primary copy
+void Worker::WriteDeltas(const std::vector<std::string>& dirs, std::string destination){
+    this->metrics.Enter(PipelinePhase::OUTPUT);
+
+    // Conflicts reconcile proved without a full read, by their metadata, samples or known digests, are read
+    // here for their chunks alone, on the hash pool. A primary file in conflict with several replicas is read once
+    std::vector<std::string> unread;
+    {
+        std::unordered_set<std::string> queued;
+        for(size_t replica = 0; replica < this->lastReconcile.size(); replica++){
+            const std::string roots[2] = {dirs[0], dirs[replica + 1]};
+            const patch_result_ptr sides[2] = {this->lastReconcile[replica].first, this->lastReconcile[replica].second};
+
+            for(int side = 0; side < 2; side++){
+                for(auto& entry : (*sides[side])[ReconcileOperation::CONFLICT]){
+                    std::string filepath = (fs::path(roots[side]) / entry->filepath).string();
+                    if(this->conflictChunks.count(filepath) == 0 && queued.insert(filepath).second){
+                        unread.push_back(filepath);
+                    }
+                }
+            }
+        }
+    }
+
+    {
+        std::vector<chunk_list> chunks(unread.size());
+        std::mutex remainingLock;
+        std::condition_variable remainingDone;
+        size_t remaining = unread.size();
+        std::exception_ptr failure;
+
+        for(size_t file = 0; file < unread.size(); file++){
+            this->hashPool->Post([&, file]{
+                try{
+                    chunks[file] = this->chunkFile(unread[file]);
+                }
+                catch(...){
+                    std::lock_guard<std::mutex> guard(remainingLock);
+                    failure = failure ? failure : std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> guard(remainingLock);
+                if(--remaining == 0){
+                    remainingDone.notify_all();
+                }
+            });
+        }
+
+        {
+            std::unique_lock<std::mutex> guard(remainingLock);
+            remainingDone.wait(guard, [&]{ return remaining == 0; });
+        }
+        if(failure){
+            std::rethrow_exception(failure);
+        }
+
+        for(size_t file = 0; file < unread.size(); file++){
+            this->conflictChunks[unread[file]] = std::move(chunks[file]);
+        }
+    }
+
+    std::ofstream outFile(destination);
+    outFile << "# Deltas for " << GetFormattedDateTime() << std::endl;
+
+    for(size_t replica = 0; replica < this->lastReconcile.size(); replica++){
+        // Reconcile saves both copies of a conflict at the same position of either side
+        auto& conflictsPrimary = (*this->lastReconcile[replica].first)[ReconcileOperation::CONFLICT];
+        auto& conflictsReplica = (*this->lastReconcile[replica].second)[ReconcileOperation::CONFLICT];
+        const std::string roots[2] = {dirs[0], dirs[replica + 1]};
+
+        outFile << "# Delta '" << roots[0] << "' -> '" << roots[1] << "'" << std::endl;
+
+        for(size_t pair = 0; pair < conflictsPrimary.size(); pair++){
+            auto ranges = ComputeDelta(
+                this->conflictChunks[(fs::path(roots[0]) / conflictsPrimary[pair]->filepath).string()],
+                this->conflictChunks[(fs::path(roots[1]) / conflictsReplica[pair]->filepath).string()]);
+            WriteDelta(outFile, conflictsReplica[pair]->filepath,
+                conflictsPrimary[pair]->size, conflictsReplica[pair]->size, ranges);
+
+            this->stats.DeltaFiles++;
+            for(auto& range : ranges){
+                (range.matched ? this->stats.DeltaBytesMatched : this->stats.DeltaBytesChanged) += range.length;
+            }
+        }
+
+        outFile << std::endl;
+    }
+
+    // A full disk may only show up when the file is closed
+    outFile.close();
+    if(!outFile){
+        throw std::runtime_error("Unable to write the deltas '" + destination + "'");
+    }
+}
+
+// Reconciles two directories within a memory budget
+void Worker::ReconcileExternal(std::string dirA, std::string dirB, std::string destination, bool ignoreUnchanged){
+    std::string tempDir = this->options.TempDirectory.empty()
+        ? fs::temp_directory_path().string()
+        : this->options.TempDirectory;
+
+    // Each concurrent scan gets a quarter of the budget for its run, the rest is left to buffers and merging
+    long runBudget = std::max(this->options.MemoryBudget / 4, 1L);
+
+    // Outlives both scans: when one of them throws, the other is waited for before every run is removed
+    TempFiles temporaries;
+
+    std::vector<std::string> runsA, runsB;
+    {
+        AllocPhaseScope phase(AllocPhase::SCAN);
+        auto scanA = std::async(std::launch::async, &Worker::ScanToRuns, this, dirA, runBudget, tempDir, std::ref(temporaries));
+        auto scanB = std::async(std::launch::async, &Worker::ScanToRuns, this, dirB, runBudget, tempDir, std::ref(temporaries));
+        try{
+            runsA = scanA.get();
+            runsB = scanB.get();
+        }
+        catch(...){
+            // Stops the other walk early, its runs are of no use anymore
+            this->cancelled = true;
+            throw;
+        }
+    }
+
+    AllocPhaseScope phase(AllocPhase::RECONCILE);
+    this->metrics.Enter(PipelinePhase::RECONCILE);
+
+    // Every open run holds a read buffer, keep their total within half of the budget
+    const long readBuffer = 64 * 1024;
+    size_t fanIn = this->options.MemoryBudget / 4 / readBuffer;
+    unsigned long long merges = 0;
+    runsA = ReduceRuns(runsA, fanIn, temporaries, tempDir, merges);
+    runsB = ReduceRuns(runsB, fanIn, temporaries, tempDir, merges);
+    this->stats.RunsMerged += merges;
+
+    auto sourceA = OpenRuns(runsA), sourceB = OpenRuns(runsB);
+    PatchSize size = WriteStreamedResult(*sourceA, *sourceB, dirA, dirB, destination, ignoreUnchanged, tempDir,
+        (int)this->options.PatchCompression);
+    if(this->options.PatchCompression > 0){
+        this->stats.PatchBytes += size.Text;
+        this->stats.PatchBytesCompressed += size.Stored;
     }
 }
 
 // Write an individual patch result
 std::stringstream Worker::WritePatchResult(std::string directory, patch_result_ptr result, bool ignoreUnchanged = false){
+    AllocScope tracking(AllocStructure::PATCH_TEXT);
     typedef std::pair<char, FileResultPtr> line;
     std::stringstream output;
-    
-    // Flatten the initial structure
-    std::vector<line> lines;
+
+    // Every operation comes out of the reconcile merge in path order, except for moves,
+    // so the lines are a merge of a few sorted lists rather than a sort
+    std::vector<std::vector<line>> lists;
     for(auto& operation_set : *result){
         ReconcileOperation operation = operation_set.first;
         auto& entries = operation_set.second;
 
-        if(operation == ReconcileOperation::UNCHANGED && ignoreUnchanged){
+        if(entries.empty() || (operation == ReconcileOperation::UNCHANGED && ignoreUnchanged)){
             continue;
         }
 
-        for(auto entry : entries){
-            lines.push_back(line((char)operation, entry));
+        std::vector<line> list;
+        list.reserve(entries.size());
+        for(auto& entry : entries){
+            list.push_back(line((char)operation, entry));
+        }
+
+        auto sorter = [](const line& a, const line& b){ return a.second->filepath < b.second->filepath; };
+        if(!std::is_sorted(list.begin(), list.end(), sorter)){
+            SortByPath(list, [](const line& entry) -> const std::string& { return entry.second->filepath; }, this->hashPool.get());
         }
+        lists.push_back(std::move(list));
     }
 
-    // Sort it by the filepath
-    auto sorter = [](const line& a, const line& b) -> bool 
-    {
-        return a.second->filepath < b.second->filepath;
-    };
-    std::sort(lines.begin(), lines.end(), sorter);
+    std::vector<line> lines;
+    std::vector<size_t> positions(lists.size(), 0);
+    while(true){
+        // Smallest head, there are at most one list per operation
+        size_t next = lists.size();
+        for(size_t list = 0; list < lists.size(); list++){
+            if(positions[list] < lists[list].size()
+                && (next == lists.size() || lists[list][positions[list]].second->filepath < lists[next][positions[next]].second->filepath)){
+                next = list;
+            }
+        }
+
+        if(next == lists.size()){
+            break;
+        }
+        lines.push_back(lists[next][positions[next]++]);
+    }
 
     // Write out the lines
     output << directory << std::endl;
     for(const line& entry: lines){
-        output << entry.first << " " << entry.second->toString() << std::endl;
+        output << entry.first << " " << entry.second->toString();
+        if(entry.first == (char)ReconcileOperation::MOVE){
+            output << " <= " << entry.second->movedFrom;
+        }
+        output << std::endl;
     }
 
     return output;
 }
 
 // Write the results to a file
-void Worker::WriteResult(std::string dirA, std::string dirB, std::string destination, bool ignoreUnchanged){
-    std::fstream outFile (destination, std::fstream::out);
-
-    // Asynchronously format the lines before writing
-    auto linesA = std::async(
-        std::launch::async, 
-        &Worker::WritePatchResult, 
-        this, 
-        dirA, this->lastReconcile->first, ignoreUnchanged);
-    auto linesB = std::async(
-        std::launch::async, 
-        &Worker::WritePatchResult, 
-        this, 
-        dirB, this->lastReconcile->second, ignoreUnchanged);
-
-    outFile << "# Results for " << GetFormattedDateTime() << std::endl;
-    outFile << "# Reconciled '" << dirA << "' '" << dirB << "'" << std::endl;
-    outFile << linesA.get().str() << std::endl;
-    outFile << linesB.get().str() << std::endl;
+void Worker::WriteResult(const std::vector<std::string>& dirs, std::string destination, bool ignoreUnchanged){
+    this->metrics.Enter(PipelinePhase::OUTPUT);
+    auto outFile = OpenPatchOutput(destination, (int)this->options.PatchCompression);
 
-    outFile.close();
+    // Asynchronously format the lines of every section before writing
+    std::vector<std::pair<std::future<std::stringstream>, std::future<std::stringstream>>> sections;
+    for(size_t replica = 0; replica < this->lastReconcile.size(); replica++){
+        auto linesPrimary = std::async(
+            std::launch::async, 
+            &Worker::WritePatchResult, 
+            this, 
+            dirs[0], this->lastReconcile[replica].first, ignoreUnchanged);
+        auto linesReplica = std::async(
+            std::launch::async, 
+            &Worker::WritePatchResult, 
+            this, 
+            dirs[replica + 1], this->lastReconcile[replica].second, ignoreUnchanged);
+
+        sections.emplace_back(std::move(linesPrimary), std::move(linesReplica));
+    }
+
+    *outFile << "# Results for " << GetFormattedDateTime() << std::endl;
+    for(size_t replica = 0; replica < sections.size(); replica++){
+        *outFile << "# Reconciled '" << dirs[0] << "' '" << dirs[replica + 1] << "'" << std::endl;
+        *outFile << sections[replica].first.get().str() << std::endl;
+        *outFile << sections[replica].second.get().str() << std::endl;
+    }
+
+    PatchSize size = ClosePatchOutput(*outFile, destination);
+    if(this->options.PatchCompression > 0){
+        this->stats.PatchBytes += size.Text;
+        this->stats.PatchBytesCompressed += size.Stored;
+    }
 }
 
 #undef CRYPTOPP_ENABLE_NAMESPACE_WEAK
\ No newline at end of file
@@ -2,18 +2,33 @@
 
 #include <boost/filesystem.hpp>
 #include <unordered_map>
-#include <unordered_set>
 #include <sstream>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <functional>
 #include <future>
+#include <mutex>
 #include <tuple>
 
 #include "argument_holder.hpp"
 #include "file_result.hpp"
+#include "worker_options.hpp"
+#include "worker_stats.hpp"
+#include "thread_pool.hpp"
+#include "file_reader.hpp"
+#include "digest_cache.hpp"
+#include "block_delta.hpp"
+#include "concurrency_controller.hpp"
+#include "pipeline_metrics.hpp"
+#include "merkle_tree.hpp"
+#include "external_reconcile.hpp"
 
 enum class ReconcileOperation : char{
     ADD = '+',
     UNCHANGED = '=',
-    CONFLICT = '!'
+    CONFLICT = '!',
+    MOVE = '>'
 };
 
 namespace std
@@ -34,13 +49,21 @@ namespace std
 }
 
 // Short-hand for worker results
-typedef std::unordered_map<std::string, FileResultPtr> scan_result;
+// Files of a scanned root, sorted by path
+typedef std::vector<FileResultPtr> scan_result;
 typedef std::unordered_map<ReconcileOperation, std::vector<FileResultPtr>> patch_result;
 typedef std::shared_ptr<patch_result> patch_result_ptr;
 typedef std::pair<patch_result_ptr, patch_result_ptr> reconcile_result;
 
-// Short hand for intermediate/working data structures
-typedef std::unordered_set<std::string> string_set;
+// Receives each reconcile result: the replica (1-based) the primary was compared with, whether the change
+// applies to the primary (or to the replica), the operation and the entry
+typedef std::function<void(size_t, bool, ReconcileOperation, const FileResultPtr&)> reconcile_sink;
+
+// Receives the full path and the (not yet hashed) result of every file found by a walk
+typedef std::function<void(const std::string&, FileResultPtr)> file_visitor;
+
+// Decides from its root-relative path whether a walk keeps an entry, rejected directories are not descended into
+typedef std::function<bool(const std::string&, bool)> entry_filter;
 
 namespace fs = boost::filesystem;
 
@@ -49,36 +72,139 @@ private:
     // An instance of the checksum function to use
     const checksum_ptr checksumInstance;
 
-    // Result of the last reconcile operation if it was saved
-    std::shared_ptr<reconcile_result> lastReconcile;
+    // Pipeline tunables
+    const WorkerOptions options;
+
+    // Counters collected while running
+    WorkerStats stats;
+
+    // Progress counters read by the metrics endpoint
+    PipelineMetrics metrics;
+
+    // Threads running the hash stage of every root, possibly shared with other workers
+    std::shared_ptr<ThreadPool> hashPool;
+
+    // Adjusts the reads in flight of every hash stage, only set when auto-tuning
+    std::unique_ptr<ConcurrencyController> tuner;
+
+    // Reads files for hashing according to the page cache policy
+    const FileReader reader;
+
+    // Digests of hardlinked files, shared by every root
+    DigestCache inodeDigests;
+
+    // Set to stop outstanding walk and hash work early
+    std::atomic<bool> cancelled;
+
+    // Directory digests of every scanned root, reconcile doesn't compare the files of subtrees identical in every root
+    std::mutex digestsLock;
+    std::unordered_map<std::string, directory_digests> directoryDigests;
+
+    // When the walk of every root started. Under deferred hashing its scan cache is only written once
+    // reconcile has computed the digests it needed
+    std::unordered_map<std::string, std::time_t> scanTimes;
+
+    // First difference proven by Check
+    std::mutex differenceLock;
+    std::string difference;
+
+    // Knob of the hash stage of a root when auto-tuning, null otherwise
+    ConcurrencyKnob* hashKnob(const std::string& root);
+
+    // Files in the largest directory above path whose digest is the same in every root, 0 when there is none
+    size_t identicalSubtree(const std::string& path, const std::vector<const directory_digests*>& digests);
+
+    // Walks a directory tree, handing every file the include/exclude patterns and the filter keep to visit
+    void walkDirectory(std::string path, const file_visitor& visit, const entry_filter& filter = entry_filter());
+
+    // Records the first difference found by Check and cancels the remaining work
+    void reportDifference(std::string description);
+
+    // Chunks of the conflicting files reconcile read in full when deltas are computed, by full path
+    std::unordered_map<std::string, chunk_list> conflictChunks;
+
+    // Result of the last reconcile operation if it was saved, one entry per replica
+    std::vector<reconcile_result> lastReconcile;
 
     // Internal implementation of Scan Directory
     scan_result scanDirectoryInternal(std::string path);
 
-    // Hashes a given file
-    std::string hashFile(std::string filepath);
+    // Persists the files of a root, whose walk started at scanned, to the scan cache. A failure is only counted,
+    // the next run reads the files again
+    void saveScanCache(const std::string& root, const scan_result& files, std::time_t scanned);
+
+    // Hashes a given file, reusing the digest of another link to the same inode. Chunks are only cut
+    // when this call reads the file
+    std::string hashFile(std::string filepath, chunk_list* chunks = nullptr);
+
+    // Reads and hashes a given file, also cutting it into content-defined chunks when chunks is given
+    std::string computeDigest(const std::string& filepath, chunk_list* chunks = nullptr);
 
-    // Fills the set with the keys of the scan_result
-    void populateSetWithKeys(std::unordered_set<std::string>& set, scan_result& result);
+    // Reads a given file only to cut it into content-defined chunks, without hashing it
+    chunk_list chunkFile(const std::string& filepath);
 
-    // Creates a patch that can introduce changes in source to target
-    patch_result_ptr createPatchData(scan_result& src, string_set& pathsSrc,
-        scan_result& target, string_set& pathsTarget,
-        string_set& unchanged, string_set& conflicts);
+    // Compares the head and tail samples of two files of the same size
+    bool samplesMatch(std::string filepathA, std::string filepathB, long size, long sampleBytes);
+
+    // Checks whether two paths are links to the same inode
+    bool sameInode(const std::string& filepathA, const std::string& filepathB);
 
     // Write an individual patch result
     std::stringstream WritePatchResult(std::string directory, patch_result_ptr result, bool ignoreUnchanged);
 
 public:
-    // ctor w/ checksum object instance
-    Worker(const checksum_ptr instance);
+    // ctor w/ checksum object instance, and optionally a hash pool shared with other workers
+    Worker(const checksum_ptr instance, const WorkerOptions& options = WorkerOptions(),
+        std::shared_ptr<ThreadPool> pool = nullptr);
+
+    // Counters collected so far
+    const WorkerStats& Stats() const;
+
+    // Progress of the pipeline in the Prometheus text format
+    std::string RenderMetrics();
+
+    // Write the wall time spent in every stage so far
+    void PrintTimings(std::ostream& out);
+
+    // Write the concurrency settings auto-tuning arrived at, nothing when not auto-tuning
+    void PrintTuning(std::ostream& out);
 
     // Asynchronously run scanDirectory
     std::future<scan_result> scanDirectory(std::string path);
 
-    // Run the reconcile operation
-    void Reconcile(scan_result& a, scan_result& b, bool keepResult);
+    // Scans the entries of one shard (see ShardOf) and writes their sorted records to a stream
+    void ScanShard(std::string path, size_t index, size_t count, std::FILE* output);
+
+    // Scans a directory into sorted run files of scan records, each run holding about runBudget bytes of entries.
+    // Runs are created in temporaries, so they are removed even when the scan fails
+    std::vector<std::string> ScanToRuns(std::string path, long runBudget, std::string tempDir, TempFiles& temporaries);
+
+    // Tells whether both trees hold the same files, stopping at the first proven difference
+    bool Check(std::string dirA, std::string dirB);
+
+    // Description of the difference that ended the last Check
+    std::string Difference();
+
+    // Run the reconcile operation of the primary root (first) against every replica in a single merge
+    void Reconcile(const std::vector<std::string>& dirs, std::vector<scan_result>& results, bool keepResult);
+
+    // Same merge as Reconcile, streaming every result to the sink instead of keeping it
+    void ReconcileTo(const std::vector<std::string>& dirs, std::vector<scan_result>& results, const reconcile_sink& sink);
+
+    // Hands every entry of the saved result to the sink
+    void VisitResult(const reconcile_sink& sink);
+
+    // Turns one-sided ADD entries whose content exists on the other side under another path into MOVE entries
+    void DetectMoves(const std::vector<std::string>& dirs);
+
+    // Describes every saved CONFLICT in matched and changed byte ranges of the replica copy against the primary copy,
+    // reusing the chunks reconcile cut when ComputeDeltas is set. Throws when a file can't be read or the deltas written
+    void WriteDeltas(const std::vector<std::string>& dirs, std::string destination);
+
+    // Reconciles two directories within a memory budget: scans spill sorted runs to tempDir
+    // and the patch is streamed out of a merge of those runs
+    void ReconcileExternal(std::string dirA, std::string dirB, std::string destination, bool ignoreUnchanged);
 
-    // Write the results to a file
-    void WriteResult(std::string dirA, std::string dirB, std::string destination, bool ignoreUnchanged);
+    // Write the results of every replica to a single file
+    void WriteResult(const std::vector<std::string>& dirs, std::string destination, bool ignoreUnchanged);
 };
\ No newline at end of file
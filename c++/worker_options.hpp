@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+
+#include "path_filter.hpp"
+
+// Order in which the hash stage issues its reads
+enum class IoOrder{
+    WALK,       // Directory iteration order
+    INODE,      // Ascending inode number
+    EXTENT      // Ascending physical offset of the first extent, inode when unavailable
+};
+
+// Page cache behaviour of the hash stage reads
+enum class ReadPolicy{
+    DEFAULT,    // Plain buffered reads
+    SEQUENTIAL, // Buffered reads with a sequential readahead hint
+    DROPBEHIND, // Sequential reads dropping the pages behind the read cursor
+    DIRECT      // O_DIRECT above DirectThreshold, DROPBEHIND below it
+};
+
+// How a sharded scan splits a tree between processes
+enum class ShardMode{
+    TOPLEVEL,   // By top-level entry, a shard only walks its own subdirectories
+    HASH        // By hash of the whole path, every shard walks the tree but only reads its own files
+};
+
+// Tunables for the scan/hash/reconcile pipeline
+struct WorkerOptions{
+    // Bytes sampled from the head and the tail of both copies of a candidate pair
+    // before they are fully hashed. 0 disables the prefilter
+    long PrefilterBytes = 0;
+
+    // Read ordering policy of the hash stage
+    IoOrder ReadOrder = IoOrder::INODE;
+
+    // Discovered files collected before a batch is ordered and dispatched. 0 waits for the whole walk
+    long BatchWindow = 4096;
+
+    // Threads shared by the hash stage of every root
+    long HashThreads = 2;
+
+    // Let the hash stage of every root hill-climb its number of reads in flight, up to TuneMaxThreads,
+    // instead of using HashThreads
+    bool AutoTune = false;
+    long TuneMaxThreads = 32;
+
+    // Throughput measurement window of the tuning
+    long TuneWindowMilliseconds = 250;
+
+    // Page cache policy of the hash stage reads
+    ReadPolicy CachePolicy = ReadPolicy::DEFAULT;
+
+    // Files at least this large are read with O_DIRECT under ReadPolicy::DIRECT
+    long DirectThreshold = 16 * 1024 * 1024;
+
+    // Hash every hardlinked inode once, whichever root and path it is reached through
+    bool DedupeInodes = true;
+
+    // Build table memory allowed to the move detection join, the join is partitioned to fit it
+    long MoveJoinMemory = 64 * 1024 * 1024;
+
+    // Memory allowed to the external memory reconcile in bytes, 0 keeps everything in memory
+    long MemoryBudget = 0;
+
+    // Where the external memory reconcile keeps its runs, the system temporary directory when empty
+    std::string TempDirectory;
+
+    // Split used by sharded scans
+    ShardMode ShardBy = ShardMode::TOPLEVEL;
+
+    // Include/exclude patterns applied to every walk
+    PathFilter Filter;
+
+    // Measure how much of every hashed file is left in the page cache
+    bool ReportPageCache = false;
+
+    // Where scans are persisted between runs, files whose size and modification time didn't change since
+    // take their digest from the previous scan instead of being read. Not persisted when empty
+    std::string ScanCacheDirectory;
+
+    // zlib level (1-9) the patch is compressed with, 0 writes plain text
+    long PatchCompression = 0;
+
+    // Chunk the two copies of every conflict after reconcile to describe their differences
+    bool ComputeDeltas = false;
+
+    // When set, the scan only records metadata and digests are computed by reconcile
+    // for the files that actually need one. Deltas defer them too: the read proving a conflict also cuts its chunks
+    bool DeferHashing() const { return this->PrefilterBytes > 0 || this->ComputeDeltas; }
+};
@@ -0,0 +1,61 @@
+#include "worker_stats.hpp"
+
+// Write a human readable summary of the non-empty counters
+void WorkerStats::Print(std::ostream& out) const{
+    if(this->EntriesPruned > 0){
+        out << "Filters: " << this->EntriesPruned << " entries pruned" << std::endl;
+    }
+    if(this->FilesHashed > 0){
+        double seconds = this->HashNanoseconds / 1e9;
+        out << "Hashing: " << this->FilesHashed << " files, "
+            << this->BytesHashed << " bytes in " << seconds << " thread-seconds ("
+            << (seconds > 0 ? this->BytesHashed / seconds / (1024 * 1024) : 0) << " MiB/s per thread)" << std::endl;
+    }
+    if(this->PageCacheFiles > 0){
+        out << "Page cache footprint: " << this->PageCacheBytes << " bytes left resident by hashing "
+            << this->PageCacheFiles << " files" << std::endl;
+    }
+    if(this->FilesDeduplicated > 0){
+        out << "Inode dedupe: " << this->FilesDeduplicated << " files, "
+            << this->BytesDeduplicated << " bytes deduplicated" << std::endl;
+    }
+    if(this->FilesFromCache > 0){
+        out << "Scan cache: " << this->FilesFromCache << " files, "
+            << this->BytesFromCache << " bytes not read again" << std::endl;
+    }
+    if(this->ScanCacheFailures > 0){
+        out << "Scan cache: " << this->ScanCacheFailures << " roots couldn't be saved" << std::endl;
+    }
+    if(this->SubtreesSkipped > 0){
+        out << "Directory digests: " << this->SubtreesSkipped << " identical subtrees, "
+            << this->FilesSkipped << " files not compared" << std::endl;
+    }
+    if(this->MovesDetected > 0){
+        out << "Moves: " << this->MovesDetected << " files, "
+            << this->MoveBytes << " bytes found under another path" << std::endl;
+    }
+    if(this->DeltaFiles > 0){
+        out << "Delta: " << this->DeltaFiles << " conflicts, "
+            << this->DeltaBytesMatched << " bytes matched, "
+            << this->DeltaBytesChanged << " bytes changed, "
+            << this->DeltaFilesRead << " files read for their chunks alone" << std::endl;
+    }
+    if(this->PatchBytes > 0){
+        out << "Patch compression: " << this->PatchBytes << " bytes written as "
+            << this->PatchBytesCompressed << " bytes" << std::endl;
+    }
+    if(this->RunsWritten > 0){
+        out << "External memory: " << this->RunsWritten << " runs written, "
+            << this->RunsMerged << " intermediate merges" << std::endl;
+    }
+    if(this->HashBatches > 0){
+        out << "Hash stage: " << this->HashBatches << " batches, "
+            << this->HashRequests << " read requests" << std::endl;
+    }
+    if(this->PrefilterPairs > 0){
+        out << "Prefilter: " << this->PrefilterPairs << " pairs sampled, "
+            << this->PrefilterConflicts << " conflicts found, "
+            << this->PrefilterBytesRead << " bytes read, "
+            << this->PrefilterBytesAvoided << " bytes not hashed" << std::endl;
+    }
+}
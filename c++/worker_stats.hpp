@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <ostream>
+
+typedef std::atomic<unsigned long long> stat_counter;
+
+// Counters updated by the worker while it runs
+struct WorkerStats{
+    // Files and directories dropped by the include/exclude patterns, a directory counting once for its whole subtree
+    stat_counter EntriesPruned{0};
+
+    // Candidate pairs compared by the head/tail prefilter
+    stat_counter PrefilterPairs{0};
+
+    // Pairs the prefilter proved to be conflicts
+    stat_counter PrefilterConflicts{0};
+
+    // Bytes read while sampling heads and tails
+    stat_counter PrefilterBytesRead{0};
+
+    // Bytes that were never hashed because the samples already differed
+    stat_counter PrefilterBytesAvoided{0};
+
+    // Hardlinked files whose digest was reused instead of read again
+    stat_counter FilesDeduplicated{0};
+    stat_counter BytesDeduplicated{0};
+
+    // Files, and their bytes, whose digest came from the scan cache instead of being read
+    stat_counter FilesFromCache{0};
+    stat_counter BytesFromCache{0};
+
+    // Roots whose scan cache couldn't be written
+    stat_counter ScanCacheFailures{0};
+
+    // Subtrees found identical in every root by their directory digests, and the files in them that were
+    // reported unchanged without being compared
+    stat_counter SubtreesSkipped{0};
+    stat_counter FilesSkipped{0};
+
+    // One-sided files found under another path on the other side, and their size
+    stat_counter MovesDetected{0};
+    stat_counter MoveBytes{0};
+
+    // Conflicts described by the delta stage, the bytes of their replica copies found in the primary copy or not,
+    // and files the delta stage read to chunk them, not counted as hashed, when reconcile hadn't read them in full
+    stat_counter DeltaFiles{0};
+    stat_counter DeltaBytesMatched{0};
+    stat_counter DeltaBytesChanged{0};
+    stat_counter DeltaFilesRead{0};
+
+    // Patch text written and its size in the file, only counted when the patch is compressed
+    stat_counter PatchBytes{0};
+    stat_counter PatchBytesCompressed{0};
+
+    // Sorted runs written by the external memory scan, and runs produced by intermediate merges
+    stat_counter RunsWritten{0};
+    stat_counter RunsMerged{0};
+
+    // Batches ordered and dispatched by the hash stage
+    stat_counter HashBatches{0};
+
+    // Read requests posted by the hash stage, a request may group several small files
+    stat_counter HashRequests{0};
+
+    // Files and bytes read by the hash stage
+    stat_counter FilesHashed{0};
+    stat_counter BytesHashed{0};
+
+    // Time spent reading and hashing, summed over the hashing threads
+    stat_counter HashNanoseconds{0};
+
+    // Bytes of the hashed files still in the page cache right after hashing, and how many files were measured
+    stat_counter PageCacheBytes{0};
+    stat_counter PageCacheFiles{0};
+
+    // Write a human readable summary of the non-empty counters
+    void Print(std::ostream& out) const;
+};
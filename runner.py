@@ -20,6 +20,10 @@ def help(args = None):
     print(" 'compare <comma-separated list of languages> <repetitions> [space-separated arguments]' run some implementations and compare the average time")
     print(" 'plot/boxplot <comma-separated list of languages> <repetitions> [space-separated arguments]' benchmark and plot the results")
     print(" 'table <comma-separated list of languages> <repetitions> [space-separated arguments]' benchmark and save a table with the results")
+    print(" 'measure <language> <repetitions> [--warmup=N] [--cache=warm|cold|both] [--confidence=P] [--threshold=percent]")
+    print("          [--baseline=file.json] [--save-baseline=file.json] [space-separated arguments]'")
+    print("     benchmark with warmup and cache control, report medians, percentiles, confidence intervals, phases and peak RSS,")
+    print("     and fail when a run is significantly slower or larger than the baseline")
     print()
 # end help
 
@@ -295,6 +299,249 @@ def table(args):
     print("Done")
 # end table
 
+def __drop_page_cache(paths):
+    # Evicts the files under the given directories from the page cache so the next run reads from the device.
+    # Dentries and inodes stay cached unless we may write to drop_caches (root). False when nothing was evicted
+    try:
+        os.sync()
+        with open('/proc/sys/vm/drop_caches', 'w') as drop_caches:
+            drop_caches.write('3')
+        return True
+    except OSError:
+        pass
+
+    evicted = False
+    for path in paths:
+        for root, _, files in os.walk(path):
+            for name in files:
+                try:
+                    descriptor = os.open(os.path.join(root, name), os.O_RDONLY)
+                except OSError:
+                    continue
+                try:
+                    os.fdatasync(descriptor)
+                    os.posix_fadvise(descriptor, 0, 0, os.POSIX_FADV_DONTNEED)
+                    evicted = True
+                except OSError:
+                    pass
+                finally:
+                    os.close(descriptor)
+    return evicted
+#end __drop_page_cache
+
+def __measured_run(process_args, run_implementation, sub_args):
+    # One run: wall time, peak RSS in bytes and the "Phase <name>: <seconds> s" lines the program printed
+    import re, subprocess, tempfile, time
+
+    phases = {}
+    if process_args is None:
+        # The implementation only knows how to run itself. The children's ru_maxrss is the largest of any child so far,
+        # the compiler included, so the peak RSS of the run itself is unavailable
+        start_time = time.perf_counter()
+        run_implementation(sub_args)
+        wall = time.perf_counter() - start_time
+        return wall, None, phases
+
+    with tempfile.TemporaryFile(mode='w+') as output:
+        start_time = time.perf_counter()
+        process = subprocess.Popen(process_args, stdout=output, stderr=subprocess.STDOUT)
+        _, status, usage = os.wait4(process.pid, 0)
+        wall = time.perf_counter() - start_time
+        process.returncode = os.waitstatus_to_exitcode(status)
+
+        if process.returncode != 0:
+            raise RuntimeError("Program run returned non-zero exit code")
+
+        output.seek(0)
+        for line in output:
+            match = re.match(r'^Phase (\w+): ([0-9.e+-]+) s$', line.strip())
+            if match:
+                phases[match.group(1)] = float(match.group(2))
+
+    return wall, usage.ru_maxrss * 1024, phases
+#end __measured_run
+
+def __percentile(ordered, fraction):
+    # Linear interpolation between the closest ranks
+    position = (len(ordered) - 1) * fraction
+    lower = int(position)
+    upper = min(lower + 1, len(ordered) - 1)
+    return ordered[lower] + (ordered[upper] - ordered[lower]) * (position - lower)
+#end __percentile
+
+def __summary(samples, confidence):
+    # Median, spread and a bootstrap confidence interval of the median
+    import random, statistics
+
+    ordered = sorted(samples)
+    generator = random.Random(0)
+    medians = sorted(statistics.median(generator.choices(ordered, k=len(ordered))) for _ in range(2000))
+    tail = (1 - confidence) / 2
+
+    return {
+        'samples': samples,
+        'median': statistics.median(ordered),
+        'mean': statistics.mean(ordered),
+        'stdev': statistics.stdev(ordered) if len(ordered) > 1 else 0.0,
+        'min': ordered[0],
+        'p10': __percentile(ordered, 0.10),
+        'p25': __percentile(ordered, 0.25),
+        'p75': __percentile(ordered, 0.75),
+        'p90': __percentile(ordered, 0.90),
+        'max': ordered[-1],
+        'ci_low': __percentile(medians, tail),
+        'ci_high': __percentile(medians, 1 - tail),
+    }
+#end __summary
+
+def __mann_whitney_p(before, after):
+    # One-sided p-value of 'after' being larger than 'before' (Mann-Whitney U, normal approximation with tie correction)
+    import math
+
+    pooled = sorted((value, group) for group, values in enumerate([before, after]) for value in values)
+    ranks = [0.0] * len(pooled)
+    tie_term = 0.0
+    start = 0
+    while start < len(pooled):
+        end = start
+        while end + 1 < len(pooled) and pooled[end + 1][0] == pooled[start][0]:
+            end += 1
+        for position in range(start, end + 1):
+            ranks[position] = (start + end) / 2 + 1
+        tied = end - start + 1
+        tie_term += tied ** 3 - tied
+        start = end + 1
+
+    n1, n2 = len(before), len(after)
+    rank_sum = sum(rank for rank, (_, group) in zip(ranks, pooled) if group == 1)
+    u = rank_sum - n2 * (n2 + 1) / 2
+    mean = n1 * n2 / 2
+    variance = n1 * n2 / 12 * ((n1 + n2 + 1) - tie_term / ((n1 + n2) * (n1 + n2 - 1)))
+    if variance <= 0:
+        return 1.0
+
+    z = (u - mean - 0.5) / math.sqrt(variance)
+    return 0.5 * math.erfc(z / math.sqrt(2))
+#end __mann_whitney_p
+
+def measure(args):
+    import json
+
+    working_dir = os.getcwd()
+    repetitions = int(args[1])
+    dir_name = args[0]
+
+    # Harness options come first, everything else goes to the implementation
+    options = {'warmup': '1', 'cache': 'both', 'confidence': '0.95', 'threshold': '5', 'baseline': None, 'save-baseline': None}
+    sub_args = []
+    for argument in args[2:]:
+        name, _, value = argument[2:].partition('=')
+        if argument.startswith('--') and name in options:
+            options[name] = value
+        else:
+            sub_args.append(argument)
+
+    warmup = int(options['warmup'])
+    confidence = float(options['confidence'])
+    threshold = float(options['threshold']) / 100
+    cache_modes = ['warm', 'cold'] if options['cache'] == 'both' else [options['cache']]
+
+    # The implementation runs from its own directory, relative inputs are relative to it
+    os.chdir(dir_name)
+    input_paths = [os.path.abspath(x) for x in sub_args if not x.startswith('-') and os.path.isdir(x)]
+    module_name = dir_name + '.run'
+    setup = import_from(module_name, 'setup')
+    build = import_from(module_name, 'build')
+    run_implementation = import_from(module_name, 'run')
+    try:
+        process_args = import_from(module_name, 'command')(sub_args)
+    except AttributeError:
+        process_args = None
+
+    setup()
+    build()
+
+    results = {}
+    print("========== Starting Measurement ==========")
+    for mode in cache_modes:
+        # Warm runs start from whatever the previous run left cached, cold runs from an evicted page cache
+        for _ in range(warmup if mode == 'warm' else 0):
+            __measured_run(process_args, run_implementation, sub_args)
+
+        walls, peak_rss, phases = [], [], {}
+        for _ in range(repetitions):
+            if mode == 'cold' and not __drop_page_cache(input_paths):
+                raise RuntimeError("Cold runs need root or input directories holding files, none were found in {}".format(sub_args))
+
+            wall, rss, run_phases = __measured_run(process_args, run_implementation, sub_args)
+            walls.append(wall)
+            peak_rss.append(rss)
+            for name, seconds in run_phases.items():
+                phases.setdefault(name, []).append(seconds)
+
+        results[mode] = {
+            'wall': __summary(walls, confidence),
+            'peak_rss': __summary(peak_rss, confidence) if None not in peak_rss else None,
+            'phases': {name: __summary(samples, confidence) for name, samples in phases.items()},
+        }
+    print("========== Finishing Measurement ==========")
+    os.chdir(working_dir)
+
+    print()
+    for mode, measured in results.items():
+        print("{} cache, {} repetitions:".format(mode, repetitions))
+        rows = [('wall (s)', measured['wall'])] + [('{} (s)'.format(name), summary) for name, summary in sorted(measured['phases'].items())]
+        if measured['peak_rss']:
+            rows.append(('peak RSS (MiB)', {key: value / (1024 * 1024) if not isinstance(value, list) else value for key, value in measured['peak_rss'].items()}))
+        for label, summary in rows:
+            print("  {:<18} median {:.4f} [{:.0%} CI {:.4f} - {:.4f}]  p10 {:.4f}  p90 {:.4f}  stdev {:.4f}".format(
+                label, summary['median'], confidence, summary['ci_low'], summary['ci_high'], summary['p10'], summary['p90'], summary['stdev']))
+        if not measured['peak_rss']:
+            print("  {:<18} unavailable, the implementation doesn't provide a command to run".format('peak RSS (MiB)'))
+    print()
+
+    baseline = {'language': dir_name, 'arguments': sub_args, 'results': results}
+    if options['save-baseline']:
+        with open(options['save-baseline'], 'w') as baseline_file:
+            json.dump(baseline, baseline_file, indent=2)
+        print("Saved baseline to '{}'".format(options['save-baseline']))
+
+    if not options['baseline']:
+        return results
+
+    with open(options['baseline'], 'r') as baseline_file:
+        reference = json.load(baseline_file)['results']
+
+    # A regression must be both larger than the threshold and statistically significant
+    regressions = []
+    for mode, measured in results.items():
+        if mode not in reference:
+            continue
+
+        metrics = [('wall', measured['wall'], reference[mode]['wall'])]
+        if measured['peak_rss'] and reference[mode]['peak_rss']:
+            metrics.append(('peak_rss', measured['peak_rss'], reference[mode]['peak_rss']))
+        metrics += [('phase ' + name, summary, reference[mode]['phases'][name])
+            for name, summary in measured['phases'].items() if name in reference[mode]['phases']]
+
+        for name, current, previous in metrics:
+            change = current['median'] / previous['median'] - 1 if previous['median'] > 0 else 0.0
+            p_value = __mann_whitney_p(previous['samples'], current['samples'])
+            verdict = 'REGRESSION' if change > threshold and p_value < 1 - confidence else 'ok'
+            print("{} cache {:<18} {:+.1%} (p = {:.3f}) {}".format(mode, name, change, p_value, verdict))
+            if verdict != 'ok':
+                regressions.append('{} cache {}'.format(mode, name))
+
+    if regressions:
+        print()
+        print("Regressed against '{}': {}".format(options['baseline'], ', '.join(regressions)))
+        sys.exit(1)
+
+    print()
+    print("No significant regression against '{}'".format(options['baseline']))
+    return results
+#end measure
+
 if __name__=="__main__":
     args = sys.argv[1:]
     working_dir = os.getcwd()